@@ -7,316 +7,866 @@
 ** Incorporates sorting (hand display), hashing (card tracking),
 ** trees (AI decisions), and graphs (game state analysis)
 **
+** Build: g++ -std=c++20 -O3 -pthread -I../BlackjackCore main.cpp (-O3 lets
+** HandBatch vectorize, C++20 for the coroutines that play() and the server run
+** games on, BlackjackCore for the cards, shoe and hands shared with Blackjack1)
+** Add -DBLACKJACK_PROFILE to print per-phase round latency percentiles at exit
+**
+** Run with --bench [results.csv] to time the hot paths instead of playing
+** Run with --alloc-check [rounds] to check simulated rounds never allocate
+** Run with --latency rounds [table] [decks] for round latency percentiles with
+** inline shuffles and with shoes shuffled ahead on a background thread
+** Run with --train rounds [file] to learn the computer players' strategy tree
+** and with --strategy file to play against a trained tree
+** Run with --casino rounds [copies] [threads] to simulate every table at once,
+** add --seed n, --checkpoint file [seconds] and --resume file for long runs
+** Run with --compare rounds [file] [--antithetic] to compare two strategies
+** Run with --adaptive width [table] [threads] to simulate until results converge
+** Run with --markov rounds [table] [threads] for a Markov model of round results
+** Run with --sweep rounds [threads] [options] to play a grid of rule variants
+** Run with --exact [file] [options] for the exact return of a round from a shoe
+** Run with --server [port] [threads] [strategy.tree] to host games for many
+** players over loopback TCP, e.g. nc 127.0.0.1 7777, until Ctrl-C or SIGTERM
+** Run with --record rounds file [table] to save the shoes a table is dealt and
+** with --replay file [strategy.tree] to play them again with another strategy
+**
 */
 
 #include <iostream>
 #include <string>
 #include <ctime>
 #include <cstdlib>
-#include <list>
 #include <map>
 #include <unordered_map>
+#include <unordered_set>
 #include <iterator>
 #include <algorithm>
 #include <random>
 #include <deque>
-#include <set>
-#include <stack>
 #include <numeric>
 #include <queue>
 #include <vector>
 #include <functional>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <new>
+#include <cstring>
+#include <cstdint>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <termios.h>
+#include <poll.h>
+#include <csignal>
+#include <coroutine>
+#include <array>
+#include <string_view>
+#include <charconv>
+#include <utility>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <cerrno>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <sstream>
+#include <cstdio>
+#include <cmath>
+
+#include "BlackjackCore.h"
 
 using namespace std;
 
+// Heap allocation counter used by the benchmarks, every operator new bumps it
+// Kept per thread so the training threads do not race on it
+static thread_local size_t allocationCount = 0;
+
+// Every replaced operator new and delete goes through these two, kept out of line
+// so the compiler never pairs an inlined malloc() with a delete expression
+__attribute__((noinline)) void* countedAllocate(size_t size, size_t alignment = 0) {
+    allocationCount++;
+    size = size ? size : 1;
+    void* p = alignment > alignof(max_align_t)
+        ? aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment) : malloc(size);
+    if (!p) throw bad_alloc();
+    return p;
+}
+
+__attribute__((noinline)) void countedRelease(void* p) noexcept {
+    free(p);
+}
+
+void* operator new(size_t size) { return countedAllocate(size); }
+void* operator new[](size_t size) { return countedAllocate(size); }
+void* operator new(size_t size, align_val_t alignment) { return countedAllocate(size, static_cast<size_t>(alignment)); }
+void* operator new[](size_t size, align_val_t alignment) { return countedAllocate(size, static_cast<size_t>(alignment)); }
+void operator delete(void* p) noexcept { countedRelease(p); }
+void operator delete[](void* p) noexcept { countedRelease(p); }
+void operator delete(void* p, size_t) noexcept { countedRelease(p); }
+void operator delete[](void* p, size_t) noexcept { countedRelease(p); }
+void operator delete(void* p, align_val_t) noexcept { countedRelease(p); }
+void operator delete[](void* p, align_val_t) noexcept { countedRelease(p); }
+void operator delete(void* p, size_t, align_val_t) noexcept { countedRelease(p); }
+void operator delete[](void* p, size_t, align_val_t) noexcept { countedRelease(p); }
+
+// Per-phase round profiling, compiled in only with -DBLACKJACK_PROFILE
+// A PhaseTimer charges the time since the last switch to the phase it was in.
+// Every thread records into its own histograms and the percentiles of all
+// threads are printed when the program exits.
+#ifdef BLACKJACK_PROFILE
+enum Phase {
+    PhaseDeal, PhaseDecide, PhaseDealer, PhaseOutcome, PhaseStats, PhaseGraph, PhasePrint, PhaseInput,
+    PhaseCount
+};
+
+const char* const phaseNames[PhaseCount] = {
+    "deal", "decide", "dealer", "outcome", "stats", "graph", "print", "input"
+};
+
+// Latency histogram, exact below 16ns then 8 buckets per power of two
+struct PhaseHistogram {
+    static constexpr int numBuckets = 16 + 60 * 8;
+    uint64_t buckets[numBuckets];
+    uint64_t count;
+    uint64_t maxNs;
+
+    PhaseHistogram() : buckets(), count(0), maxNs(0) {}
+
+    static int bucketOf(uint64_t ns) {
+        if (ns < 16) return static_cast<int>(ns);
+        int msb = 63 - __builtin_clzll(ns);
+        return 16 + (msb - 4) * 8 + static_cast<int>((ns >> (msb - 3)) & 7);
+    }
+
+    static uint64_t bucketStart(int bucket) {
+        if (bucket < 16) return bucket;
+        int msb = 4 + (bucket - 16) / 8;
+        return (1ULL << msb) + (static_cast<uint64_t>((bucket - 16) % 8) << (msb - 3));
+    }
+
+    void add(uint64_t ns) {
+        buckets[bucketOf(ns)]++;
+        count++;
+        maxNs = max(maxNs, ns);
+    }
+
+    void merge(const PhaseHistogram& other) {
+        for (int b = 0; b < numBuckets; b++) {
+            buckets[b] += other.buckets[b];
+        }
+        count += other.count;
+        maxNs = max(maxNs, other.maxNs);
+    }
+
+    // Start of the bucket holding the given fraction of samples
+    uint64_t percentile(double fraction) const {
+        uint64_t target = static_cast<uint64_t>(fraction * count);
+        uint64_t seen = 0;
+        for (int b = 0; b < numBuckets; b++) {
+            seen += buckets[b];
+            if (seen > target) return bucketStart(b);
+        }
+        return maxNs;
+    }
+};
+
+struct ThreadProfile {
+    PhaseHistogram phases[PhaseCount];
+};
+
+// Every thread's profile, kept until exit so finished threads still get reported
+struct ProfileRegistry {
+    mutex lock;
+    vector<unique_ptr<ThreadProfile>> profiles;
+
+    ~ProfileRegistry() {
+        PhaseHistogram total[PhaseCount];
+        for (const auto& profile : profiles) {
+            for (int p = 0; p < PhaseCount; p++) {
+                total[p].merge(profile->phases[p]);
+            }
+        }
+        cout << endl << left << setw(10) << "phase" << right << setw(12) << "count" << setw(10) << "p50 ns"
+             << setw(10) << "p90 ns" << setw(10) << "p99 ns" << setw(11) << "p99.9 ns" << setw(12) << "max ns" << endl;
+        for (int p = 0; p < PhaseCount; p++) {
+            if (total[p].count == 0) continue;
+            cout << left << setw(10) << phaseNames[p] << right << setw(12) << total[p].count
+                 << setw(10) << total[p].percentile(0.5) << setw(10) << total[p].percentile(0.9)
+                 << setw(10) << total[p].percentile(0.99) << setw(11) << total[p].percentile(0.999)
+                 << setw(12) << total[p].maxNs << endl;
+        }
+    }
+};
+
+ProfileRegistry profileRegistry;
+
+ThreadProfile& threadProfile() {
+    thread_local ThreadProfile* profile = nullptr;
+    if (!profile) {
+        lock_guard<mutex> guard(profileRegistry.lock);
+        profileRegistry.profiles.push_back(unique_ptr<ThreadProfile>(new ThreadProfile()));
+        profile = profileRegistry.profiles.back().get();
+    }
+    return *profile;
+}
+
+class PhaseTimer {
+private:
+    Phase phase;
+    chrono::steady_clock::time_point start;
+
+    void record(chrono::steady_clock::time_point now) {
+        threadProfile().phases[phase].add(chrono::duration_cast<chrono::nanoseconds>(now - start).count());
+    }
+
+public:
+    explicit PhaseTimer(Phase first) : phase(first), start(chrono::steady_clock::now()) {}
+
+    void switchTo(Phase next) {
+        auto now = chrono::steady_clock::now();
+        record(now);
+        phase = next;
+        start = now;
+    }
+
+    ~PhaseTimer() {
+        record(chrono::steady_clock::now());
+    }
+};
+
+#define PROFILE_BEGIN(phase) PhaseTimer phaseTimer(phase)
+#define PROFILE_SWITCH(phase) phaseTimer.switchTo(phase)
+#else
+#define PROFILE_BEGIN(phase)
+#define PROFILE_SWITCH(phase)
+#endif
+
+// Binary snapshot helpers, values are stored in the machine's byte order
+template <typename T>
+void writeValue(ostream& out, const T& value) {
+    out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T>
+bool readValue(istream& in, T& value) {
+    return static_cast<bool>(in.read(reinterpret_cast<char*>(&value), sizeof(T)));
+}
+
+void writeString(ostream& out, const string& text) {
+    writeValue(out, static_cast<uint32_t>(text.size()));
+    out.write(text.data(), text.size());
+}
+
+bool readString(istream& in, string& text) {
+    uint32_t length;
+    if (!readValue(in, length) || length > (1u << 30)) return false;
+    text.resize(length);
+    return static_cast<bool>(in.read(&text[0], length));
+}
+
 // Forward declaration for DecisionTree and GameGraph
 class DecisionTree;
 class GameGraph;
 
-// Cards class represents a single playing card
-class Cards {
+// Output buffer for a whole screen, sent to the terminal or a socket in one write
+// It starts at 4 KiB, enough for a table screen, and doubles when a screen needs
+// more. clear() keeps the memory, so after the first few rounds formatting a
+// round into it allocates nothing, and thousands of server sessions stay small.
+class ScreenBuffer {
 private:
-    char suit; // Suit: H, D, C, S
-    int value; // Value: 1-13 (Ace=1, Jack=11, Queen=12, King=13)
-    static const map<int, string> valueNames; // Maps values to names (e.g., 1 -> "Ace")
-    static const map<char, string> suitNames; // Maps suits to names (e.g., 'H' -> "Hearts")
+    string text; // Only the first used bytes hold the screen
+    size_t used;
+
+    // Make room for size more bytes, doubling so growth happens a few times at most
+    char* reserve(size_t size) {
+        if (used + size > text.size()) {
+            text.resize(max(text.size() * 2, used + size));
+        }
+        return &text[used];
+    }
 
 public:
-    Cards() : suit(' '), value(0) {}
-    Cards(int v, char s) : value(v), suit(s) {}
+    ScreenBuffer() : text(1 << 12, '\0'), used(0) {}
 
-    // Display the card in a human-readable format
-    void display() const {
-        if (valueNames.find(value) != valueNames.end()) {
-            cout << valueNames.at(value);
-        } else {
-            cout << value;
-        }
-        cout << " of ";
-        auto it = suitNames.find(suit);
-        if (it != suitNames.end())
-            cout << it->second;
-        else
-            cout << "Unknown";
+    ScreenBuffer& operator<<(string_view part) {
+        memcpy(reserve(part.size()), part.data(), part.size());
+        used += part.size();
+        return *this;
     }
 
-    // Get the Blackjack value of the card
-    int getValue() const {
-        if (value > 10) return 10; // Face cards worth 10
-        return value;
+    // String literals keep their length known at compile time
+    template <size_t N>
+    ScreenBuffer& operator<<(const char (&part)[N]) {
+        return *this << string_view(part, N - 1);
     }
 
-    // Comparison for sorting or set operations
-    bool operator<(const Cards& other) const {
-        return (suit < other.suit) || (suit == other.suit && value < other.value);
+    ScreenBuffer& operator<<(const char* part) {
+        return *this << string_view(part);
     }
 
-    // Equality for hashing
-    bool operator==(const Cards& other) const {
-        return suit == other.suit && value == other.value;
+    ScreenBuffer& operator<<(const CardName& name) {
+        memcpy(reserve(sizeof(name.text)), name.text, sizeof(name.text));
+        used += name.length;
+        return *this;
     }
 
-    // Getters for suit and value
-    char getSuit() const { return suit; }
-    int getRawValue() const { return value; }
-};
+    ScreenBuffer& operator<<(const string& part) {
+        return *this << string_view(part);
+    }
 
-// Static member definitions
-const map<int, string> Cards::valueNames = {
-    {1, "Ace"},
-    {11, "Jack"},
-    {12, "Queen"},
-    {13, "King"}
+    ScreenBuffer& operator<<(char c) {
+        *reserve(1) = c;
+        used++;
+        return *this;
+    }
+
+    ScreenBuffer& operator<<(int number) {
+        char* out = reserve(11);
+        used = to_chars(out, out + 11, number).ptr - text.data();
+        return *this;
+    }
+
+    string_view view() const {
+        return string_view(text.data(), used);
+    }
+
+    size_t size() const {
+        return used;
+    }
+
+    void clear() {
+        used = 0;
+    }
 };
 
-const map<char, string> Cards::suitNames = {
-    {'H', "Hearts"},
-    {'D', "Diamonds"},
-    {'C', "Clubs"},
-    {'S', "Spades"}
+// SpscQueue is a fixed size lock-free ring buffer for one producer and one consumer
+// The producer only writes tail and the consumer only writes head, so the two sides
+// never wait on each other, a full queue just makes push() return false
+template <typename T, size_t Capacity>
+class SpscQueue {
+private:
+    T slots[Capacity];
+    alignas(64) atomic<size_t> head; // Next slot to pop, written by the consumer
+    alignas(64) atomic<size_t> tail; // Next slot to push, written by the producer
+
+public:
+    SpscQueue() : head(0), tail(0) {}
+
+    // Producer side check, lets the producer wait before doing work it cannot hand off
+    bool full() const {
+        return tail.load(memory_order_relaxed) - head.load(memory_order_acquire) == Capacity;
+    }
+
+    bool push(const T& item) {
+        size_t t = tail.load(memory_order_relaxed);
+        if (t - head.load(memory_order_acquire) == Capacity) return false;
+        slots[t % Capacity] = item;
+        tail.store(t + 1, memory_order_release);
+        return true;
+    }
+
+    bool pop(T& item) {
+        size_t h = head.load(memory_order_relaxed);
+        if (h == tail.load(memory_order_acquire)) return false;
+        item = slots[h % Capacity];
+        head.store(h + 1, memory_order_release);
+        return true;
+    }
 };
 
-// Custom hash function for Cards
-namespace std {
-    template <>
-    struct hash<Cards> {
-        size_t operator()(const Cards& card) const {
-            return hash<char>()(card.getSuit()) ^ (hash<int>()(card.getRawValue()) << 1);
+// ShufflePool shuffles shoes ahead of time on a background thread
+// Shoes are packed cards in buffers that travel between the two threads by pointer:
+// the producer takes an empty buffer from spare, shuffles into it and pushes it to
+// ready, Deck pops it, copies the cards out and hands the buffer back. Neither
+// side locks, so a reshuffle in deal() no longer runs the random number generator.
+// The producer sleeps on an atomic wait while the ring is full and Deck wakes it
+// once half the buffers are back, so it refills in bursts instead of polling.
+class ShufflePool {
+private:
+    static constexpr size_t numShoes = 16;
+
+    vector<uint8_t> shoeTemplate; // Unshuffled packed shoe
+    vector<uint8_t> storage; // numShoes buffers of shoeTemplate.size() bytes
+    SpscQueue<uint8_t*, numShoes> ready; // Shuffled shoes, producer to Deck
+    SpscQueue<uint8_t*, numShoes> spare; // Used buffers, Deck to producer
+    atomic<bool> stopping;
+    atomic<uint32_t> wakeups; // Bumped to wake the producer
+    long long misses; // Shoes Deck had to shuffle itself, only touched by the consumer
+    size_t returned; // Buffers given back, only touched by the consumer
+    thread producer;
+
+    void produce(uint32_t seed) {
+        mt19937 rng(seed);
+        uint8_t* shoe;
+        while (!stopping.load(memory_order_relaxed)) {
+            uint32_t seen = wakeups.load(memory_order_acquire);
+            if (!spare.pop(shoe)) {
+                wakeups.wait(seen, memory_order_acquire);
+                continue;
+            }
+            copy(shoeTemplate.begin(), shoeTemplate.end(), shoe);
+            std::shuffle(shoe, shoe + shoeTemplate.size(), rng);
+            ready.push(shoe); // Never full, there are only numShoes buffers
         }
-    };
-}
+    }
+
+public:
+    // Shoes of decks full decks, shuffled by a generator started from seed
+    ShufflePool(int decks, uint32_t seed) : stopping(false), wakeups(0), misses(0), returned(0) {
+        char suits[4] = {'H', 'D', 'C', 'S'};
+        for (int d = 0; d < decks; d++) {
+            for (int s = 0; s < 4; s++) {
+                for (int v = 1; v <= 13; v++) {
+                    shoeTemplate.push_back(Cards(v, suits[s]).pack());
+                }
+            }
+        }
+        storage.resize(numShoes * shoeTemplate.size());
+        for (size_t i = 0; i < numShoes; i++) {
+            spare.push(&storage[i * shoeTemplate.size()]);
+        }
+        producer = thread(&ShufflePool::produce, this, seed);
+    }
+
+    ~ShufflePool() {
+        stopping.store(true);
+        wakeups.fetch_add(1, memory_order_release);
+        wakeups.notify_one();
+        producer.join();
+    }
+
+    ShufflePool(const ShufflePool&) = delete;
+    ShufflePool& operator=(const ShufflePool&) = delete;
+
+    size_t shoeSize() const {
+        return shoeTemplate.size();
+    }
+
+    // Consumer side: the next shuffled shoe, or nullptr when the producer is behind
+    // The buffer must be given back with release() once the cards are copied out
+    const uint8_t* take() {
+        uint8_t* shoe;
+        if (ready.pop(shoe)) return shoe;
+        misses++;
+        return nullptr;
+    }
+
+    void release(const uint8_t* shoe) {
+        spare.push(const_cast<uint8_t*>(shoe));
+        if (++returned % (numShoes / 2) == 0) {
+            wakeups.fetch_add(1, memory_order_release);
+            wakeups.notify_one();
+        }
+    }
+
+    long long missed() const {
+        return misses;
+    }
+};
 
 // Deck class manages the card deck
+// The cards themselves are a Shoe from BlackjackCore, Deck adds where new shoes
+// come from (shuffling, a replay or a ShufflePool), recording and snapshots
 class Deck {
 private:
-    deque<Cards> cards; // Main deck
-    unordered_map<size_t, Cards> dealtCards; // Hashed dealt cards
-    stack<Cards> cardsStack; // Alternative deck representation
-    list<Cards> backupDeck; // Backup for reshuffling
-    int top; // Tracks dealt cards
+    Shoe shoe; // Packed cards, dealt from the back
+    ostream* recorder; // Gets every new shoe while recording, see ShoeReplay
+    const uint8_t* replayShoes; // Recorded shoes dealt in place of shuffling
+    size_t replayCount; // Number of recorded shoes
+    size_t replayNext; // Next recorded shoe to deal
+    bool replayExhausted; // Every recorded shoe has been dealt and the replay wrapped around
+    ShufflePool* pool; // Shuffles shoes ahead of time on its own thread, if set
 
 public:
-    Deck() : top(0) {
-        char suit[4] = {'H', 'D', 'C', 'S'};
-        for (int i = 0; i < 4; i++) {
-            for (int j = 1; j <= 13; j++) {
-                cards.push_back(Cards(j, suit[i]));
-            }
-        }
-        copy(cards.begin(), cards.end(), back_inserter(backupDeck));
+    Deck() : recorder(nullptr), replayShoes(nullptr), replayCount(0), replayNext(0),
+             replayExhausted(false), pool(nullptr) {}
+
+    // Use a shoe of several decks, reshuffled after penetration (0-1] of it is dealt
+    void setShoe(int decks, double penetration) {
+        shoe.setDecks(decks, penetration);
+        if (pool && pool->shoeSize() != static_cast<size_t>(shoe.size())) pool = nullptr;
         shuffle();
     }
 
-    // Shuffle the deck using Mersenne Twister
+    // Restart from a fresh deck with a fixed seed so the same shoes come out again
+    // The antithetic shoe is the same shuffle with every rank mirrored, see Shoe::seed()
+    void seed(uint32_t value, bool antithetic = false) {
+        shoe.seed(value, antithetic);
+    }
+
+    // Shuffle the deck using Mersenne Twister, or take the next shoe of a replay
+    // or a shoe the pool has shuffled already
     void shuffle() {
-        random_device rd;
-        mt19937 rng(rd());
-        std::shuffle(cards.begin(), cards.end(), rng);
-        top = 0;
-        while (!cardsStack.empty()) {
-            cardsStack.pop();
+        const uint8_t* pooled = nullptr;
+        if (replayShoes) {
+            if (replayNext == replayCount) {
+                replayNext = 0;
+                replayExhausted = true;
+            }
+            shoe.load(replayShoes + replayNext++ * shoe.size());
+        } else if (pool && (pooled = pool->take())) {
+            shoe.load(pooled);
+            pool->release(pooled);
+        } else {
+            shoe.shuffle();
         }
-        for (const auto& card : cards) {
-            cardsStack.push(card);
+        if (recorder) {
+            recorder->write(reinterpret_cast<const char*>(shoe.data()), shoe.size());
         }
-        dealtCards.clear();
+    }
+
+    // Write every shoe from now on to out, one packed byte per card in deck order
+    // Starts a new shoe so the recording begins on a shoe boundary, nullptr stops
+    void setRecorder(ostream* out) {
+        recorder = out;
+        if (recorder) shuffle();
+    }
+
+    // Deal count recorded shoes of size() packed cards each instead of shuffling
+    // The memory is not copied and must outlive the replay. Starts on the first shoe.
+    void setReplay(const uint8_t* shoes, size_t count) {
+        replayShoes = count > 0 ? shoes : nullptr;
+        replayCount = count;
+        replayNext = 0;
+        replayExhausted = false;
+        if (replayShoes) shuffle();
+    }
+
+    // True once a replay has run out of recorded shoes
+    bool replayFinished() const {
+        return replayExhausted;
+    }
+
+    // Take shoes from a ShufflePool from the next reshuffle on, nullptr to stop
+    // The pool must deal shoes of this deck's size and outlive its use here. It has
+    // its own generator, so seed() no longer decides the later shoes.
+    bool setShufflePool(ShufflePool* shoes) {
+        if (shoes && shoes->shoeSize() != static_cast<size_t>(shoe.size())) return false;
+        pool = shoes;
+        return true;
     }
 
     // Deal a card and track it
     Cards deal() {
-        if (top >= cards.size() || cardsStack.empty()) {
-            cards.clear();
-            copy(backupDeck.begin(), backupDeck.end(), back_inserter(cards));
-            shuffle();
-        }
-        Cards card = cardsStack.top();
-        cardsStack.pop();
-        dealtCards[hash<Cards>()(card)] = card;
-        top++;
-        return card;
+        if (shoe.needsShuffle()) shuffle();
+        return shoe.deal();
+    }
+
+    // Count the cards still to be dealt by Blackjack value, counts[1] is aces and
+    // counts[10] holds tens and face cards
+    void remainingCounts(int counts[11]) const {
+        shoe.remainingCounts(counts);
     }
 
     // Check if a card has been dealt
     bool isCardDealt(const Cards& card) const {
-        return dealtCards.find(hash<Cards>()(card)) != dealtCards.end();
+        return shoe.isCardDealt(card);
+    }
+
+    // Write card order, position and generator state
+    // The generator's text form is stored as binary 32-bit words
+    void save(ostream& out) const {
+        writeValue(out, static_cast<int32_t>(shoe.dealt()));
+        out.write(reinterpret_cast<const char*>(shoe.data()), shoe.size());
+        stringstream text;
+        text << shoe.generator();
+        vector<uint32_t> words;
+        uint32_t word;
+        while (text >> word) {
+            words.push_back(word);
+        }
+        writeValue(out, static_cast<uint32_t>(words.size()));
+        for (uint32_t w : words) {
+            writeValue(out, w);
+        }
+    }
+
+    // Read a deck written by save(), the dealt cards are rebuilt from the position
+    bool load(istream& in) {
+        int32_t position;
+        if (!readValue(in, position) || position < 0 || position > shoe.size()) return false;
+        vector<uint8_t> cards(shoe.size());
+        if (!in.read(reinterpret_cast<char*>(cards.data()), cards.size())) return false;
+        uint32_t count;
+        if (!readValue(in, count) || count > 1000) return false;
+        stringstream text;
+        for (uint32_t i = 0; i < count; i++) {
+            uint32_t word;
+            if (!readValue(in, word)) return false;
+            text << word << ' ';
+        }
+        if (!(text >> shoe.generator())) return false;
+
+        shoe.load(cards.data());
+        shoe.setDealt(position);
+        return true;
     }
 };
 
-// Hand class represents a player's or dealer's hand
-class Hand {
+// HandBatch holds many hands as parallel arrays (structure of arrays) instead of
+// one list per hand. evaluate() fills the total, soft, bust and Blackjack flags for
+// every hand in one branch free loop over byte arrays, which the compiler turns
+// into SIMD code that works on a full vector of hands per instruction.
+class HandBatch {
 private:
-    list<Cards> cards; // List of cards in hand
+    vector<uint8_t> hardTotals; // Sum with every ace counted as 1
+    vector<uint8_t> aces; // Number of aces in each hand
+    vector<uint8_t> cardCounts; // Cards in each hand, capped at 10 like Hand
+    vector<uint8_t> totals; // Results of the last evaluate()
+    vector<uint8_t> softFlags;
+    vector<uint8_t> bustFlags;
+    vector<uint8_t> blackjackFlags;
 
 public:
-    Hand() {}
-
-    // Add a card to the hand
-    void addCard(Cards card) {
-        if (cards.size() < 10) {
-            cards.push_back(card);
-        }
-    }
-
-    // Calculate the hand's Blackjack value
-    int getValue() const {
-        int value = accumulate(cards.begin(), cards.end(), 0, [](int sum, const Cards& card) {
-            return sum + (card.getValue() == 1 ? 11 : card.getValue());
-        });
-        int ace = 0;
-        auto it = cards.begin();
-        while (it != cards.end()) {
-            it = find_if(it, cards.end(), [](const Cards& card) { return (card.getValue() == 1); });
-            if (it != cards.end()) {
-                ace++;
-                ++it;
-            }
-        }
-        while (value > 21 && ace > 0) {
-            value -= 10;
-            ace--;
-        }
-        return value;
-    }
-
-    // Display hand, sorting cards by value then suit
-    void display(bool hideFirst = false) {
-        vector<Cards> sortedCards(cards.begin(), cards.end());
-        sort(sortedCards.begin(), sortedCards.end(), [](const Cards& a, const Cards& b) {
-            if (a.getRawValue() != b.getRawValue())
-                return a.getRawValue() < b.getRawValue();
-            return a.getSuit() < b.getSuit();
-        });
-
-        bool val = hideFirst;
-        for (const auto& card : sortedCards) {
-            if (val) {
-                cout << "[Hidden]";
-                val = false;
-            } else {
-                card.display();
-            }
-            cout << "... ";
-        }
+    explicit HandBatch(size_t count = 0) {
+        resize(count);
     }
 
-    // Check if hand is bust
-    bool isBust() const {
-        return getValue() > 21;
+    // Change the number of hands, new hands start empty
+    void resize(size_t count) {
+        hardTotals.resize(count);
+        aces.resize(count);
+        cardCounts.resize(count);
+        totals.resize(count);
+        softFlags.resize(count);
+        bustFlags.resize(count);
+        blackjackFlags.resize(count);
     }
 
-    // Check if hand is Blackjack
-    bool isBlackjack() const {
-        return getValue() == 21;
+    size_t size() const {
+        return hardTotals.size();
     }
 
-    // Clear the hand
+    // Empty every hand
     void clear() {
-        cards.clear();
+        fill(hardTotals.begin(), hardTotals.end(), 0);
+        fill(aces.begin(), aces.end(), 0);
+        fill(cardCounts.begin(), cardCounts.end(), 0);
+    }
+
+    // Empty one hand
+    void clearHand(size_t hand) {
+        hardTotals[hand] = 0;
+        aces[hand] = 0;
+        cardCounts[hand] = 0;
+    }
+
+    // Add a card to one hand
+    void addCard(size_t hand, const Cards& card) {
+        if (cardCounts[hand] < 10) {
+            hardTotals[hand] += static_cast<uint8_t>(card.getValue());
+            aces[hand] += card.getValue() == 1 ? 1 : 0;
+            cardCounts[hand]++;
+        }
+    }
+
+    // Evaluate every hand, only one ace can ever count as 11 so a hand is soft
+    // when it holds an ace and the extra 10 still fits under 21
+    void evaluate() {
+        evaluateHands(size(), hardTotals.data(), aces.data(), totals.data(),
+                      softFlags.data(), bustFlags.data(), blackjackFlags.data());
     }
 
-    // Get copy of cards for decision tree
-    list<Cards> getCards() const {
-        return cards;
+    // The SIMD kernel, __restrict promises the arrays do not overlap so the
+    // compiler can vectorize without runtime alias checks
+    static void evaluateHands(size_t count, const uint8_t* __restrict hard, const uint8_t* __restrict ace,
+                              uint8_t* __restrict total, uint8_t* __restrict soft,
+                              uint8_t* __restrict bust, uint8_t* __restrict blackjack) {
+        for (size_t i = 0; i < count; i++) {
+            uint8_t isSoft = (ace[i] != 0) & (hard[i] <= 11);
+            uint8_t value = hard[i] + (isSoft ? 10 : 0);
+            total[i] = value;
+            soft[i] = isSoft;
+            bust[i] = value > 21;
+            blackjack[i] = value == 21;
+        }
+    }
+
+    int getValue(size_t hand) const {
+        return totals[hand];
+    }
+
+    bool isSoft(size_t hand) const {
+        return softFlags[hand] != 0;
+    }
+
+    bool isBust(size_t hand) const {
+        return bustFlags[hand] != 0;
+    }
+
+    bool isBlackjack(size_t hand) const {
+        return blackjackFlags[hand] != 0;
     }
 };
 
 // DecisionTree class for computer player decisions
+// Nodes live side by side in one vector and point at their children by index,
+// so a large learned tree is one allocation and walking it stays in cache
 class DecisionTree {
+public:
+    // What a split node looks at
+    enum Feature : uint8_t {
+        HandValue = 0,
+        DealerUpCard = 1,
+        Soft = 2
+    };
+
 private:
     struct Node {
-        bool isLeaf;
-        bool hit; // Decision if leaf
-        int minValue; // Hand value range
-        int maxValue;
-        int dealerUpCard; // Dealer's visible card value
-        Node* left; // Lower value branch
-        Node* right; // Higher value branch
-
-        Node(int minV, int maxV, int dealerUp = 0)
-            : isLeaf(false), hit(false), minValue(minV), maxValue(maxV),
-              dealerUpCard(dealerUp), left(nullptr), right(nullptr) {}
-        ~Node() {
-            delete left;
-            delete right;
-        }
+        uint8_t feature; // Feature this node splits on
+        uint8_t hit; // Decision if leaf
+        int16_t threshold; // Go right when feature > threshold
+        uint32_t child[2]; // Left and right child indices, a leaf points at itself
     };
 
-    Node* root;
+    vector<Node> nodes; // Arena holding every node
+    vector<uint32_t> heights; // Height of each node, only used while building
+    uint32_t root;
+    int depth; // Steps needed to reach any leaf from the root
 
     // Build decision tree
     void buildTree() {
-        root = new Node(4, 21);
-        root->left = new Node(4, 11); // Soft hands or low value
-        root->right = new Node(12, 21); // Hard hands
+        uint32_t hitLeaf = addLeaf(true);
+        uint32_t standLeaf = addLeaf(false);
+
+        // 12-16: Consider dealer's up card, stand vs. 2-6 and hit vs. 7-A
+        uint32_t weakDealer = addSplit(DealerUpCard, 6, standLeaf, hitLeaf);
+        uint32_t midHands = addSplit(DealerUpCard, 1, hitLeaf, weakDealer);
+
+        // Hard hands: 12-16 depends on the dealer, 17-21 always stand
+        uint32_t hardHands = addSplit(HandValue, 16, midHands, standLeaf);
+
+        // Always hit below 12
+        setRoot(addSplit(HandValue, 11, hitLeaf, hardHands));
+    }
 
-        // Low value hands
-        root->left->isLeaf = true;
-        root->left->hit = true; // Always hit below 12
+public:
+    DecisionTree() : root(0), depth(0) {
+        buildTree();
+    }
 
-        // Hard hands
-        root->right->left = new Node(12, 16);
-        root->right->right = new Node(17, 21);
+    // Remove every node so a new tree can be built
+    void clear() {
+        nodes.clear();
+        heights.clear();
+        root = 0;
+        depth = 0;
+    }
 
-        // 12-16: Consider dealer's up card
-        root->right->left->left = new Node(12, 16, 2); // Dealer 2-6
-        root->right->left->right = new Node(12, 16, 7); // Dealer 7-A
-        root->right->left->left->isLeaf = true;
-        root->right->left->left->hit = false; // Stand vs. weak dealer
-        root->right->left->right->isLeaf = true;
-        root->right->left->right->hit = true; // Hit vs. strong dealer
+    // Reserve space for a tree of known size so building it does not reallocate
+    void reserve(size_t count) {
+        nodes.reserve(count);
+        heights.reserve(count);
+    }
 
-        // 17-21: Always stand
-        root->right->right->isLeaf = true;
-        root->right->right->hit = false;
+    // Add a leaf and return its index
+    uint32_t addLeaf(bool hit) {
+        uint32_t index = static_cast<uint32_t>(nodes.size());
+        nodes.push_back({HandValue, static_cast<uint8_t>(hit), INT16_MAX, {index, index}});
+        heights.push_back(0);
+        return index;
     }
 
-    // Traverse tree to make decision
-    bool decideHit(Node* node, int handValue, int dealerUpCard) const {
-        if (node->isLeaf) {
-            return node->hit;
-        }
-        if (handValue <= node->left->maxValue) {
-            return decideHit(node->left, handValue, dealerUpCard);
-        }
-        if (node->left->dealerUpCard == 0 || (dealerUpCard >= 2 && dealerUpCard <= 6)) {
-            return decideHit(node->left, handValue, dealerUpCard);
-        }
-        return decideHit(node->right, handValue, dealerUpCard);
+    // Add a split whose children were already added and return its index
+    // Features are small, so clamping the threshold to 16 bits never changes a decision
+    uint32_t addSplit(Feature feature, int threshold, uint32_t left, uint32_t right) {
+        uint32_t index = static_cast<uint32_t>(nodes.size());
+        int16_t stored = static_cast<int16_t>(min(max(threshold, static_cast<int>(INT16_MIN)), static_cast<int>(INT16_MAX)));
+        nodes.push_back({feature, 0, stored, {left, right}});
+        heights.push_back(1 + max(heights[left], heights[right]));
+        return index;
     }
 
-public:
-    DecisionTree() : root(nullptr) {
-        buildTree();
+    // Choose the node decisions start from
+    void setRoot(uint32_t index) {
+        root = index;
+        depth = static_cast<int>(heights[index]);
+    }
+
+    size_t size() const {
+        return nodes.size();
+    }
+
+    // Write the tree as text, one node per line in arena order
+    // "L hit" for a leaf, "S feature threshold left right" for a split
+    void save(ostream& out) const {
+        out << nodes.size() << " " << root << endl;
+        for (uint32_t i = 0; i < nodes.size(); i++) {
+            const Node& node = nodes[i];
+            if (node.child[0] == i && node.child[1] == i) {
+                out << "L " << static_cast<int>(node.hit) << endl;
+            } else {
+                out << "S " << static_cast<int>(node.feature) << " " << node.threshold << " "
+                    << node.child[0] << " " << node.child[1] << endl;
+            }
+        }
     }
 
-    ~DecisionTree() {
-        delete root;
+    // Read a tree written by save(), children must come before their parents
+    // Returns false and leaves the tree empty if the file is malformed
+    bool load(istream& in) {
+        size_t count;
+        uint32_t rootIndex;
+        clear();
+        if (!(in >> count >> rootIndex) || rootIndex >= count) return false;
+
+        // Every node takes at least 4 bytes ("L 0\n"), so a count the rest of the
+        // file cannot hold is corrupt and must not size the arena
+        streampos here = in.tellg();
+        if (here != streampos(-1) && in.seekg(0, ios::end)) {
+            streamoff remaining = in.tellg() - here;
+            in.seekg(here);
+            if (count > static_cast<size_t>(remaining) / 4 + 1) return false;
+            reserve(count);
+        } else {
+            in.clear();
+            reserve(min(count, static_cast<size_t>(1) << 16));
+        }
+        for (size_t i = 0; i < count; i++) {
+            char kind;
+            if (!(in >> kind)) break;
+            if (kind == 'L') {
+                int hit;
+                if (!(in >> hit)) break;
+                addLeaf(hit != 0);
+            } else if (kind == 'S') {
+                int feature, threshold;
+                uint32_t left, right;
+                if (!(in >> feature >> threshold >> left >> right)) break;
+                if (feature < 0 || feature > Soft || left >= i || right >= i) break;
+                if (threshold < INT16_MIN || threshold > INT16_MAX) break;
+                addSplit(static_cast<Feature>(feature), threshold, left, right);
+            } else {
+                break;
+            }
+        }
+        if (nodes.size() != count) {
+            clear();
+            return false;
+        }
+        setRoot(rootIndex);
+        return true;
     }
 
     // Decide whether to hit based on hand and dealer's up card
-    bool shouldHit(int handValue, int dealerUpCard) const {
+    // Walks a fixed number of steps, leaves loop back on themselves so there is no
+    // leaf test and the only branch is the loop itself
+    bool shouldHit(int handValue, int dealerUpCard, bool soft = false) const {
         if (handValue > 21) return false;
-        return decideHit(root, handValue, dealerUpCard);
+        int features[3] = {handValue, dealerUpCard, soft ? 1 : 0};
+        uint32_t index = root;
+        for (int step = 0; step < depth; step++) {
+            const Node& node = nodes[index];
+            index = node.child[features[node.feature] > node.threshold];
+        }
+        return nodes[index].hit != 0;
     }
 };
 
@@ -369,132 +919,522 @@ public:
         currentRound++;
     }
 
-    // Print graph summary
+    // Print graph summary, to a stream or a ScreenBuffer
     void printSummary() const {
-        cout << "Game Graph Summary:" << endl;
+        printSummary(cout);
+    }
+
+    template <typename Out>
+    void printSummary(Out& out) const {
+        out << "Game Graph Summary:" << '\n';
         for (const auto& node : nodes) {
-            cout << "Round " << node->roundNumber << ": ";
+            out << "Round " << node->roundNumber << ": ";
             for (const auto& pv : node->playerValues) {
-                cout << pv.first << "=" << pv.second << " ";
+                out << pv.first << "=" << pv.second << " ";
             }
-            cout << "Dealer=" << node->dealerValue << endl;
-            cout << "Outcomes: ";
+            out << "Dealer=" << node->dealerValue << '\n';
+            out << "Outcomes: ";
             for (const auto& outcome : node->outcomes) {
-                cout << outcome.first << (outcome.second ? " won" : " lost") << " ";
+                out << outcome.first << (outcome.second ? " won" : " lost") << " ";
             }
-            cout << endl;
+            out << '\n';
         }
     }
-};
-
-// Blackjack class manages the game
-class Blackjack {
-private:
-    Deck deck;
-    vector<Hand> players;
-    Hand dealer;
-    map<string, int> stats;
-    int numPlayers;
-    DecisionTree ai;
-    GameGraph gameGraph;
 
-public:
-    Blackjack(int num) : numPlayers(num) {
-        srand(static_cast<unsigned>(time(0)));
-        deck.shuffle();
-        players.resize(numPlayers);
-        stats["Dealer"] = 0;
-        stats["Tie"] = 0;
-        for (int i = 0; i < numPlayers; i++) {
-            stats["Player" + to_string(i + 1)] = 0;
+    // Write every node in round order, the neighbors are rebuilt as a chain on load
+    void save(ostream& out) const {
+        writeValue(out, static_cast<int32_t>(currentRound));
+        writeValue(out, static_cast<uint32_t>(nodes.size()));
+        for (const auto& node : nodes) {
+            writeValue(out, static_cast<int32_t>(node->roundNumber));
+            writeValue(out, static_cast<int32_t>(node->dealerValue));
+            writeValue(out, static_cast<uint32_t>(node->playerValues.size()));
+            for (const auto& pv : node->playerValues) {
+                writeString(out, pv.first);
+                writeValue(out, static_cast<int32_t>(pv.second));
+            }
+            writeValue(out, static_cast<uint32_t>(node->outcomes.size()));
+            for (const auto& outcome : node->outcomes) {
+                writeString(out, outcome.first);
+                writeValue(out, static_cast<uint8_t>(outcome.second));
+            }
         }
     }
 
-    void play() {
-        char playAgain;
-        do {
-            cout << endl;
-            for (auto& player : players) {
-                player.clear();
+    bool load(istream& in) {
+        for (auto node : nodes) {
+            delete node;
+        }
+        nodes.clear();
+        int32_t round;
+        uint32_t count;
+        if (!readValue(in, round) || !readValue(in, count)) return false;
+        currentRound = round;
+        for (uint32_t i = 0; i < count; i++) {
+            int32_t number, dealerValue;
+            uint32_t entries;
+            if (!readValue(in, number) || !readValue(in, dealerValue) || !readValue(in, entries)) return false;
+            map<string, int> playerValues;
+            for (uint32_t e = 0; e < entries; e++) {
+                string name;
+                int32_t value;
+                if (!readString(in, name) || !readValue(in, value)) return false;
+                playerValues[name] = value;
             }
-            dealer.clear();
-
-            // Deal initial cards
-            for (int round = 0; round < 2; round++) {
-                for (int i = 0; i < numPlayers; i++) {
-                    players[i].addCard(deck.deal());
-                }
-                dealer.addCard(deck.deal());
+            Node* node = new Node(number, playerValues, dealerValue);
+            if (!nodes.empty()) nodes.back()->neighbors.push_back(node);
+            nodes.push_back(node);
+            if (!readValue(in, entries)) return false;
+            for (uint32_t e = 0; e < entries; e++) {
+                string name;
+                uint8_t won;
+                if (!readString(in, name) || !readValue(in, won)) return false;
+                node->outcomes[name] = won != 0;
             }
+        }
+        return true;
+    }
+};
 
-            // Display all hands
-            bool val = true;
-            cout << "Dealer's hand: ";
-            dealer.display(val);
-            cout << endl;
-            for (int i = 0; i < numPlayers; i++) {
-                cout << "Player " << (i + 1) << "'s hand: ";
-                players[i].display(false);
-                cout << endl;
-            }
+// Result of a finished hand for the player: 1 win, 0 tie, -1 loss
+// Same order of checks as the outcome table in Blackjack::play()
+int roundReward(const Hand& player, const Hand& dealer) {
+    if (player.isBust()) return -1;
+    if (dealer.isBust()) return 1;
+    if (player.isBlackjack() && !dealer.isBlackjack()) return 1;
+    if (dealer.isBlackjack() && !player.isBlackjack()) return -1;
+    if (player.getValue() > dealer.getValue()) return 1;
+    if (player.getValue() < dealer.getValue()) return -1;
+    return 0;
+}
 
-            // Process Player 1 (human) turn
-            if (!players[0].isBlackjack()) {
-                char choice;
-                do {
-                    cout << "Player 1, Hit or Stand? (h/s) ";
-                    cin >> choice;
-                    if (choice == 's' || choice == 'S') {
-                        cout << "Player 1's total card value is: " << players[0].getValue() << endl;
-                        break;
-                    }
-                    if (choice == 'h' || choice == 'H') {
-                        players[0].addCard(deck.deal());
-                        cout << "Player 1 adds: ";
-                        players[0].display(false);
-                        cout << endl;
-                        if (players[0].isBust()) {
-                            cout << "Player 1 busts!" << endl;
-                            break;
-                        } else if (players[0].isBlackjack()) {
-                            cout << "Player 1 has Blackjack!" << endl;
-                            break;
-                        }
-                    }
-                } while ((choice == 'h' || choice == 'H') && !players[0].isBust());
-            } else {
-                cout << "Player 1 has Blackjack!" << endl;
-            }
+// When the dealer draws, best is the highest total of the players still in
+enum DealerRule {
+    HitBelow17UnlessAhead, // Blackjack2: under 17 and not already ahead of the players
+    HitUntilAhead, // Blackjack1: under 17 or still behind the player
+    HitBelow17 // Casino standard: under 17 no matter what
+};
+
+// constexpr so the switch folds away when the rule is a compile time constant
+constexpr bool dealerHits(DealerRule rule, int dealerValue, int best) {
+    switch (rule) {
+        case HitUntilAhead:
+            return dealerValue < 17 || dealerValue < best;
+        case HitBelow17:
+            return dealerValue < 17;
+        default:
+            return dealerValue < 17 && dealerValue <= best;
+    }
+}
+
+// Outcome of one simulated round, counted per seat
+struct RoundResult {
+    int table; // Casino table that played it
+    long long hands;
+    long long playerWins;
+    long long dealerWins;
+    long long ties;
+};
+
+// Keystrokes for a game running as a coroutine, and the screen it writes
+// The game co_awaits nextKey(), which suspends it until the code driving it (the
+// terminal in play() or a connection of the server) calls deliver() with a key.
+// The driver sends out the screen each time the game stops to wait.
+class KeySource {
+private:
+    coroutine_handle<> waiting;
+    char key = 0;
+
+public:
+    ScreenBuffer screen;
+
+    struct KeyAwaiter {
+        KeySource& source;
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(coroutine_handle<> handle) noexcept { source.waiting = handle; }
+        char await_resume() const noexcept { return source.key; }
+    };
+
+    // Wait for the next key, 0 means the input has ended
+    KeyAwaiter nextKey() {
+        return KeyAwaiter{*this};
+    }
+
+    // Hand a key to the waiting game and run it until it waits again or ends
+    void deliver(char value) {
+        key = value;
+        coroutine_handle<> handle = waiting;
+        waiting = nullptr;
+        if (handle) handle.resume();
+    }
+};
+
+// A game coroutine, it runs as soon as it is created up to its first nextKey()
+// and is destroyed with the GameTask
+class GameTask {
+public:
+    struct promise_type {
+        GameTask get_return_object() { return GameTask(coroutine_handle<promise_type>::from_promise(*this)); }
+        suspend_never initial_suspend() noexcept { return {}; }
+        suspend_always final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { terminate(); }
+    };
+
+    GameTask() : handle(nullptr) {}
+    explicit GameTask(coroutine_handle<promise_type> h) : handle(h) {}
+    GameTask(GameTask&& other) noexcept : handle(exchange(other.handle, nullptr)) {}
+    GameTask& operator=(GameTask&& other) noexcept {
+        if (this != &other) {
+            if (handle) handle.destroy();
+            handle = exchange(other.handle, nullptr);
+        }
+        return *this;
+    }
+    GameTask(const GameTask&) = delete;
+    GameTask& operator=(const GameTask&) = delete;
+    ~GameTask() {
+        if (handle) handle.destroy();
+    }
+
+    bool done() const {
+        return !handle || handle.done();
+    }
+
+private:
+    coroutine_handle<promise_type> handle;
+};
+
+// Terminal front end for play(): single keystrokes in, one write per screen out
+// When stdin is a terminal it leaves line mode, so a key counts as soon as it is
+// pressed and poll() lets the game keep a spinner turning while it waits. Piped
+// input falls back to cin so scripted games keep working.
+class Terminal {
+private:
+    bool raw; // stdin is a terminal in single key mode
+
+    // Settings to put back on exit, static so the signal handler can reach them
+    static termios& savedSettings() {
+        static termios settings;
+        return settings;
+    }
+
+    // Ctrl-C must not leave the shell without echo
+    static void onSignal(int signalNumber) {
+        tcsetattr(STDIN_FILENO, TCSANOW, &savedSettings());
+        signal(signalNumber, SIG_DFL);
+        raise(signalNumber);
+    }
+
+    void writeAll(const char* data, size_t size) {
+        while (size > 0) {
+            ssize_t written = ::write(STDOUT_FILENO, data, size);
+            if (written <= 0) {
+                if (written < 0 && errno == EINTR) continue;
+                return;
+            }
+            data += written;
+            size -= written;
+        }
+    }
+
+public:
+    Terminal() : raw(false) {
+        if (isatty(STDIN_FILENO) && tcgetattr(STDIN_FILENO, &savedSettings()) == 0) {
+            termios settings = savedSettings();
+            settings.c_lflag &= ~(ICANON | ECHO);
+            settings.c_cc[VMIN] = 1;
+            settings.c_cc[VTIME] = 0;
+            raw = tcsetattr(STDIN_FILENO, TCSANOW, &settings) == 0;
+            if (raw) {
+                signal(SIGINT, onSignal);
+                signal(SIGTERM, onSignal);
+            }
+        }
+    }
+
+    ~Terminal() {
+        if (raw) {
+            tcsetattr(STDIN_FILENO, TCSANOW, &savedSettings());
+            signal(SIGINT, SIG_DFL);
+            signal(SIGTERM, SIG_DFL);
+        }
+    }
+
+    Terminal(const Terminal&) = delete;
+    Terminal& operator=(const Terminal&) = delete;
+
+    // Write everything composed in screen with one call and empty it
+    void write(ScreenBuffer& screen) {
+        cout.flush(); // Anything printed straight to cout goes out first
+        writeAll(screen.view().data(), screen.size());
+        screen.clear();
+    }
+
+    // Wait up to timeoutMs for a key, -1 on timeout and 0 at the end of input
+    int readKey(int timeoutMs) {
+        if (!raw) {
+            char key;
+            return (cin >> key) ? static_cast<unsigned char>(key) : 0;
+        }
+        pollfd input = {STDIN_FILENO, POLLIN, 0};
+        if (poll(&input, 1, timeoutMs) <= 0) return -1;
+        char key;
+        return read(STDIN_FILENO, &key, 1) == 1 ? static_cast<unsigned char>(key) : 0;
+    }
+
+    // Wait for a key that is not whitespace and echo it, turning a spinner after
+    // the prompt in the meantime. Returns 0 at the end of input.
+    char waitKey() {
+        static const char frames[4] = {'|', '/', '-', '\\'};
+        int frame = 0;
+        while (true) {
+            int key = readKey(250);
+            if (key == -1) {
+                char text[2] = {'\b', frames[frame % 4]};
+                writeAll(frame == 0 ? text + 1 : text, frame == 0 ? 1 : 2);
+                frame++;
+                continue;
+            }
+            if (key != 0 && isspace(key)) continue;
+            if (raw) {
+                char text[3] = {'\b', static_cast<char>(key ? key : ' '), '\n'};
+                writeAll(frame == 0 ? text + 1 : text, frame == 0 ? 2 : 3);
+            }
+            return static_cast<char>(key);
+        }
+    }
+};
+
+// Blackjack class manages the game
+class Blackjack {
+private:
+    Deck deck;
+    vector<Hand> players;
+    Hand dealer;
+    map<string, int> stats;
+    int numPlayers;
+    DecisionTree ai;
+    GameGraph gameGraph;
+    bool recordGraph; // Long simulations turn this off so the graph does not grow forever
+    DealerRule dealerRule; // Only used by simulated rounds, play() keeps the Blackjack2 rule
+    vector<int> rewards; // Each seat's result in the last simulated round
+    vector<string> seatNames; // "Player1", "Player2"... built once so stat updates do not build strings
+
+public:
+    Blackjack(int num) : numPlayers(num), recordGraph(true), dealerRule(HitBelow17UnlessAhead) {
+        srand(static_cast<unsigned>(time(0)));
+        deck.shuffle();
+        players.resize(numPlayers);
+        rewards.resize(numPlayers);
+        stats["Dealer"] = 0;
+        stats["Tie"] = 0;
+        for (int i = 0; i < numPlayers; i++) {
+            seatNames.push_back("Player" + to_string(i + 1));
+            stats[seatNames[i]] = 0;
+        }
+    }
+
+    // Seed the deck so simulated rounds can be repeated exactly
+    void seed(uint32_t value) {
+        deck.seed(value);
+    }
+
+    // Write deck, stats and game graph so a simulation can continue later
+    void saveState(ostream& out) const {
+        writeValue(out, static_cast<int32_t>(numPlayers));
+        deck.save(out);
+        writeValue(out, static_cast<uint32_t>(stats.size()));
+        for (const auto& stat : stats) {
+            writeString(out, stat.first);
+            writeValue(out, static_cast<int32_t>(stat.second));
+        }
+        gameGraph.save(out);
+    }
+
+    // Read a state written by saveState() for a game with the same number of players
+    bool loadState(istream& in) {
+        int32_t seats;
+        uint32_t count;
+        if (!readValue(in, seats) || seats != numPlayers) return false;
+        if (!deck.load(in) || !readValue(in, count)) return false;
+        stats.clear();
+        for (uint32_t i = 0; i < count; i++) {
+            string name;
+            int32_t value;
+            if (!readString(in, name) || !readValue(in, value)) return false;
+            stats[name] = value;
+        }
+        return gameGraph.load(in);
+    }
+
+    // Rule simulated rounds use for the dealer
+    void setDealerRule(DealerRule rule) {
+        dealerRule = rule;
+    }
+
+    // Deal simulated rounds from a shoe of several decks
+    void setShoe(int decks, double penetration) {
+        deck.setShoe(decks, penetration);
+    }
+
+    // Write every shoe the game deals to out, see Deck::setRecorder()
+    void recordShoes(ostream* out) {
+        deck.setRecorder(out);
+    }
+
+    // Deal shoes shuffled ahead of time, see Deck::setShufflePool()
+    bool useShufflePool(ShufflePool* pool) {
+        return deck.setShufflePool(pool);
+    }
+
+    // Deal recorded shoes instead of shuffled ones, see Deck::setReplay()
+    void replayShoes(const uint8_t* shoes, size_t count) {
+        deck.setReplay(shoes, count);
+    }
+
+    // True once the recorded shoes have all been dealt
+    bool replayFinished() const {
+        return deck.replayFinished();
+    }
+
+    // Result of one seat in the last simulated round: 1 win, 0 tie, -1 loss
+    int seatReward(int seat) const {
+        return rewards[seat];
+    }
+
+    // Final totals of the last simulated round
+    int seatValue(int seat) const {
+        return players[seat].getValue();
+    }
+
+    int dealerValue() const {
+        return dealer.getValue();
+    }
+
+    // Turn recording of simulated rounds in the game graph on or off
+    void setRecordGraph(bool record) {
+        recordGraph = record;
+    }
+
+    // Replace the computer players' strategy, e.g. with a trained tree
+    void setStrategy(const DecisionTree& tree) {
+        ai = tree;
+    }
+
+    // Format the dealer's and every player's hand into screen, hiding the dealer's
+    // first card while the players are still deciding
+    void renderTable(ScreenBuffer& screen, bool hideDealer) const {
+        screen << "Dealer's hand: ";
+        dealer.display(hideDealer, screen);
+        screen << '\n';
+        for (int i = 0; i < numPlayers; i++) {
+            screen << "Player " << (i + 1) << "'s hand: ";
+            players[i].display(false, screen);
+            screen << '\n';
+        }
+    }
+
+    // Play rounds with Player 1 at the keyboard
+    // Every line of a round goes into one buffer that is written out in a single
+    // call just before the game waits for a key, instead of flushing line by line
+    void play() {
+        Terminal terminal;
+        KeySource input;
+        GameTask game = session(input);
+        while (!game.done()) {
+            terminal.write(input.screen);
+            input.deliver(terminal.waitKey());
+        }
+        terminal.write(input.screen);
+    }
+
+    // The rounds of play() as a coroutine, Player 1's keys come from input
+    // It only suspends while waiting for a key, the computer seats and the dealer
+    // run straight through, so one thread can drive any number of sessions.
+    GameTask session(KeySource& input) {
+        ScreenBuffer& screen = input.screen;
+        char playAgain;
+        do {
+            PROFILE_BEGIN(PhaseDeal);
+            screen << '\n';
+            for (auto& player : players) {
+                player.clear();
+            }
+            dealer.clear();
+
+            // Deal initial cards
+            for (int round = 0; round < 2; round++) {
+                for (int i = 0; i < numPlayers; i++) {
+                    players[i].addCard(deck.deal());
+                }
+                dealer.addCard(deck.deal());
+            }
+
+            // Display all hands
+            PROFILE_SWITCH(PhasePrint);
+            renderTable(screen, true);
+
+            // Process Player 1 (human) turn
+            PROFILE_SWITCH(PhaseInput);
+            if (!players[0].isBlackjack()) {
+                char choice;
+                do {
+                    screen << "Player 1, Hit or Stand? (h/s) ";
+                    choice = co_await input.nextKey();
+                    if (choice == 's' || choice == 'S') {
+                        screen << "Player 1's total card value is: " << players[0].getValue() << '\n';
+                        break;
+                    }
+                    if (choice == 'h' || choice == 'H') {
+                        players[0].addCard(deck.deal());
+                        screen << "Player 1 adds: ";
+                        players[0].display(false, screen);
+                        screen << '\n';
+                        if (players[0].isBust()) {
+                            screen << "Player 1 busts!" << '\n';
+                            break;
+                        } else if (players[0].isBlackjack()) {
+                            screen << "Player 1 has Blackjack!" << '\n';
+                            break;
+                        }
+                    }
+                } while ((choice == 'h' || choice == 'H') && !players[0].isBust());
+            } else {
+                screen << "Player 1 has Blackjack!" << '\n';
+            }
 
             // Process computer players' turns
-            int dealerUpCard = dealer.getCards().front().getValue();
+            PROFILE_SWITCH(PhaseDecide);
+            int dealerUpCard = dealer.getCard(0).getValue();
             for (int i = 1; i < numPlayers; i++) {
                 if (!players[i].isBlackjack()) {
-                    while (ai.shouldHit(players[i].getValue(), dealerUpCard) && !players[i].isBust()) {
+                    while (ai.shouldHit(players[i].getValue(), dealerUpCard, players[i].isSoft()) && !players[i].isBust()) {
                         players[i].addCard(deck.deal());
-                        cout << "Player " << (i + 1) << " hits: ";
-                        players[i].display(false);
-                        cout << endl;
+                        screen << "Player " << (i + 1) << " hits: ";
+                        players[i].display(false, screen);
+                        screen << '\n';
                         if (players[i].isBust()) {
-                            cout << "Player " << (i + 1) << " busts!" << endl;
+                            screen << "Player " << (i + 1) << " busts!" << '\n';
                             break;
                         } else if (players[i].isBlackjack()) {
-                            cout << "Player " << (i + 1) << " has Blackjack!" << endl;
+                            screen << "Player " << (i + 1) << " has Blackjack!" << '\n';
                             break;
                         }
                     }
                     if (!players[i].isBust() && !players[i].isBlackjack()) {
-                        cout << "Player " << (i + 1) << " stands with: " << players[i].getValue() << endl;
+                        screen << "Player " << (i + 1) << " stands with: " << players[i].getValue() << '\n';
                     }
                 } else {
-                    cout << "Player " << (i + 1) << " has Blackjack!" << endl;
+                    screen << "Player " << (i + 1) << " has Blackjack!" << '\n';
                 }
             }
 
             // Process dealer's turn
-            cout << endl << "Dealer's hand: ";
-            dealer.display(false);
-            cout << endl;
+            PROFILE_SWITCH(PhaseDealer);
+            screen << '\n' << "Dealer's hand: ";
+            dealer.display(false, screen);
+            screen << '\n';
             bool anyPlayerActive = false;
             int maxPlayerValue = 0;
             for (const auto& player : players) {
@@ -506,66 +1446,2507 @@ public:
             if (anyPlayerActive) {
                 while (dealer.getValue() < 17 && dealer.getValue() <= maxPlayerValue) {
                     dealer.addCard(deck.deal());
-                    cout << "Dealer hits: ";
-                    dealer.display(false);
-                    cout << endl;
+                    screen << "Dealer hits: ";
+                    dealer.display(false, screen);
+                    screen << '\n';
                 }
                 if (dealer.isBust()) {
-                    cout << "Dealer busts!" << endl;
+                    screen << "Dealer busts!" << '\n';
                 } else if (dealer.isBlackjack()) {
-                    cout << "Dealer has Blackjack!" << endl;
+                    screen << "Dealer has Blackjack!" << '\n';
                 }
             }
 
             // Determine outcomes
+            PROFILE_SWITCH(PhaseOutcome);
             for (int i = 0; i < numPlayers; i++) {
                 if (players[i].isBust()) {
-                    cout << "Player " << (i + 1) << " busted. Dealer wins!" << endl;
+                    screen << "Player " << (i + 1) << " busted. Dealer wins!" << '\n';
                     stats["Dealer"]++;
                 } else if (dealer.isBust()) {
-                    cout << "Dealer busts! Player " << (i + 1) << " wins!" << endl;
-                    stats["Player" + to_string(i + 1)]++;
+                    screen << "Dealer busts! Player " << (i + 1) << " wins!" << '\n';
+                    stats[seatNames[i]]++;
                 } else if (players[i].isBlackjack() && !dealer.isBlackjack()) {
-                    cout << "Player " << (i + 1) << " has Blackjack! You win!" << endl;
-                    stats["Player" + to_string(i + 1)]++;
+                    screen << "Player " << (i + 1) << " has Blackjack! You win!" << '\n';
+                    stats[seatNames[i]]++;
                 } else if (dealer.isBlackjack() && !players[i].isBlackjack()) {
-                    cout << "Dealer has Blackjack! Player " << (i + 1) << " loses!" << endl;
+                    screen << "Dealer has Blackjack! Player " << (i + 1) << " loses!" << '\n';
                     stats["Dealer"]++;
                 } else if (players[i].getValue() > dealer.getValue()) {
-                    cout << "Player " << (i + 1) << " wins!" << endl;
-                    stats["Player" + to_string(i + 1)]++;
+                    screen << "Player " << (i + 1) << " wins!" << '\n';
+                    stats[seatNames[i]]++;
                 } else if (players[i].getValue() < dealer.getValue()) {
-                    cout << "Player " << (i + 1) << " loses!" << endl;
+                    screen << "Player " << (i + 1) << " loses!" << '\n';
                     stats["Dealer"]++;
                 } else {
-                    cout << "Player " << (i + 1) << " pushes! It's a tie." << endl;
+                    screen << "Player " << (i + 1) << " pushes! It's a tie." << '\n';
                     stats["Tie"]++;
                 }
             }
 
             // Record game state in graph
+            PROFILE_SWITCH(PhaseGraph);
             gameGraph.addState(players, dealer, stats);
 
             // Display game statistics
-            cout << endl << "Game Statistics:" << endl;
+            PROFILE_SWITCH(PhasePrint);
+            screen << '\n' << "Game Statistics:" << '\n';
             for (auto it = stats.begin(); it != stats.end(); ++it) {
-                cout << it->first << ": " << it->second << " wins" << endl;
+                screen << it->first << ": " << it->second << " wins" << '\n';
             }
             auto maxWins = max_element(stats.begin(), stats.end(),
                 [](const auto& a, const auto& b) { return a.second < b.second; });
-            cout << "Leading: " << maxWins->first << " with " << maxWins->second << " wins" << endl;
+            screen << "Leading: " << maxWins->first << " with " << maxWins->second << " wins" << '\n';
 
             // Print game graph summary
-            gameGraph.printSummary();
+            gameGraph.printSummary(screen);
 
-            cout << endl;
-            cout << "Play again? (y/n): ";
-            cin >> playAgain;
+            screen << '\n';
+            screen << "Play again? (y/n): ";
+            PROFILE_SWITCH(PhaseInput);
+            playAgain = co_await input.nextKey();
         } while (playAgain == 'Y' || playAgain == 'y');
     }
+
+    // Play one silent round where every seat, Player 1 included, uses the decision tree
+    // Same rules as play(), used by the benchmarks and the casino simulation
+    RoundResult simulateRound() {
+        PROFILE_BEGIN(PhaseDeal);
+        for (auto& player : players) {
+            player.clear();
+        }
+        dealer.clear();
+
+        for (int round = 0; round < 2; round++) {
+            for (int i = 0; i < numPlayers; i++) {
+                players[i].addCard(deck.deal());
+            }
+            dealer.addCard(deck.deal());
+        }
+
+        PROFILE_SWITCH(PhaseDecide);
+        int dealerUpCard = dealer.getCard(0).getValue();
+        for (int i = 0; i < numPlayers; i++) {
+            while (!players[i].isBlackjack() && ai.shouldHit(players[i].getValue(), dealerUpCard, players[i].isSoft())) {
+                players[i].addCard(deck.deal());
+            }
+        }
+
+        PROFILE_SWITCH(PhaseDealer);
+        int maxPlayerValue = 0;
+        bool anyPlayerActive = false;
+        for (const auto& player : players) {
+            if (!player.isBust()) {
+                anyPlayerActive = true;
+                maxPlayerValue = max(maxPlayerValue, player.getValue());
+            }
+        }
+        if (anyPlayerActive) {
+            while (dealerHits(dealerRule, dealer.getValue(), maxPlayerValue)) {
+                dealer.addCard(deck.deal());
+            }
+        }
+
+        PROFILE_SWITCH(PhaseOutcome);
+        RoundResult result = {0, numPlayers, 0, 0, 0};
+        for (int i = 0; i < numPlayers; i++) {
+            rewards[i] = roundReward(players[i], dealer);
+            result.playerWins += rewards[i] > 0;
+            result.dealerWins += rewards[i] < 0;
+            result.ties += rewards[i] == 0;
+        }
+
+        PROFILE_SWITCH(PhaseStats);
+        for (int i = 0; i < numPlayers; i++) {
+            if (rewards[i] > 0) {
+                stats[seatNames[i]]++;
+            } else if (rewards[i] < 0) {
+                stats["Dealer"]++;
+            } else {
+                stats["Tie"]++;
+            }
+        }
+
+        PROFILE_SWITCH(PhaseGraph);
+        if (recordGraph) {
+            gameGraph.addState(players, dealer, stats);
+        }
+        return result;
+    }
 };
 
-int main(int argc, char** argv) {
+// Rule set for RoundEngine, fixed at compile time
+template <DealerRule Rule, int Seats>
+struct TableRules {
+    static constexpr DealerRule dealerRule = Rule;
+    static constexpr int seats = Seats;
+};
+
+// RoundEngine plays silent rounds with the rules baked in as template parameters
+// The seat loops have a constant trip count and the dealer rule is a constant, so
+// every configuration compiles into its own loop with the rule branches folded
+// away. It keeps no stats map or game graph, only the RoundResult of each round.
+template <typename Rules>
+class RoundEngine {
+private:
+    Deck deck;
+    Hand players[Rules::seats];
+    Hand dealer;
+    DecisionTree ai;
+
+public:
+    void seed(uint32_t value) {
+        deck.seed(value);
+    }
+
+    void setStrategy(const DecisionTree& tree) {
+        ai = tree;
+    }
+
+    // Same deal order, decisions and outcome checks as Blackjack::simulateRound()
+    RoundResult playRound() {
+        for (auto& player : players) {
+            player.clear();
+        }
+        dealer.clear();
+
+        for (int round = 0; round < 2; round++) {
+            for (auto& player : players) {
+                player.addCard(deck.deal());
+            }
+            dealer.addCard(deck.deal());
+        }
+
+        int dealerUpCard = dealer.getCard(0).getValue();
+        for (auto& player : players) {
+            while (!player.isBlackjack() && ai.shouldHit(player.getValue(), dealerUpCard, player.isSoft())) {
+                player.addCard(deck.deal());
+            }
+        }
+
+        int maxPlayerValue = 0;
+        bool anyPlayerActive = false;
+        for (const auto& player : players) {
+            if (!player.isBust()) {
+                anyPlayerActive = true;
+                maxPlayerValue = max(maxPlayerValue, player.getValue());
+            }
+        }
+        if (anyPlayerActive) {
+            while (dealerHits(Rules::dealerRule, dealer.getValue(), maxPlayerValue)) {
+                dealer.addCard(deck.deal());
+            }
+        }
+
+        RoundResult result = {0, Rules::seats, 0, 0, 0};
+        for (const auto& player : players) {
+            int reward = roundReward(player, dealer);
+            result.playerWins += reward > 0;
+            result.dealerWins += reward < 0;
+            result.ties += reward == 0;
+        }
+        return result;
+    }
+
+    int seatReward(int seat) const {
+        return roundReward(players[seat], dealer);
+    }
+};
+
+// The two programs as named rule sets: Blackjack1 is one player against a dealer
+// who draws until ahead, Blackjack2 is a table of Seats against the stricter dealer
+using Blackjack1Engine = RoundEngine<TableRules<HitUntilAhead, 1>>;
+template <int Seats>
+using Blackjack2Engine = RoundEngine<TableRules<HitBelow17UnlessAhead, Seats>>;
+
+// WorkStealingPool runs tasks on a fixed set of threads
+// Every worker has its own deque, it takes its newest task first and when it runs
+// dry it steals the oldest task from another worker, so busy workers share load
+class WorkStealingPool {
+private:
+    struct Worker {
+        mutex lock;
+        deque<function<void()>> tasks;
+    };
+
+    vector<unique_ptr<Worker>> workers;
+    vector<thread> threads;
+    atomic<bool> stopping;
+
+    static thread_local int currentWorker; // Index of the worker running this thread, -1 outside
+
+    bool popOwn(int index, function<void()>& task) {
+        Worker& worker = *workers[index];
+        lock_guard<mutex> guard(worker.lock);
+        if (worker.tasks.empty()) return false;
+        task = move(worker.tasks.back());
+        worker.tasks.pop_back();
+        return true;
+    }
+
+    bool steal(int thief, function<void()>& task) {
+        int count = static_cast<int>(workers.size());
+        for (int offset = 1; offset < count; offset++) {
+            Worker& victim = *workers[(thief + offset) % count];
+            lock_guard<mutex> guard(victim.lock);
+            if (!victim.tasks.empty()) {
+                task = move(victim.tasks.front());
+                victim.tasks.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void run(int index) {
+        currentWorker = index;
+        function<void()> task;
+        while (!stopping.load(memory_order_acquire)) {
+            if (popOwn(index, task) || steal(index, task)) {
+                task();
+            } else {
+                this_thread::yield();
+            }
+        }
+    }
+
+public:
+    explicit WorkStealingPool(int count) : stopping(false) {
+        for (int i = 0; i < count; i++) {
+            workers.push_back(unique_ptr<Worker>(new Worker()));
+        }
+        for (int i = 0; i < count; i++) {
+            threads.emplace_back([this, i]() { run(i); });
+        }
+    }
+
+    ~WorkStealingPool() {
+        stopping.store(true, memory_order_release);
+        for (auto& t : threads) {
+            t.join();
+        }
+    }
+
+    // Queue a task on the calling worker, or spread them out when called from outside
+    void submit(function<void()> task, int hint = 0) {
+        int count = static_cast<int>(workers.size());
+        int index = currentWorker >= 0 ? currentWorker : hint % count;
+        lock_guard<mutex> guard(workers[index]->lock);
+        workers[index]->tasks.push_back(move(task));
+    }
+
+    int size() const {
+        return static_cast<int>(workers.size());
+    }
+};
+
+thread_local int WorkStealingPool::currentWorker = -1;
+
+// Casino runs every table from the main() menu at once
+// Each table is a task on the pool that plays a batch of rounds, pushes each
+// result into its own lock-free queue and then queues itself again. The main
+// thread is the aggregator and drains all the queues until every table is done.
+//
+// For checkpoints every table publishes a snapshot of its game after each batch
+// through a triple buffer: the table writes a back buffer and swaps it into the
+// middle, the aggregator swaps the middle out to read it, and neither ever waits.
+// A checkpoint file is the latest snapshot of every table, and since each table
+// has its own seeded deck, resuming gives exactly the results of an unbroken run.
+class Casino {
+private:
+    static constexpr int roundsPerTask = 256;
+    static constexpr uint32_t checkpointMagic = 0x4b434a42; // "BJCK"
+    static constexpr uint32_t checkpointVersion = 1;
+
+    // One table's progress, everything needed to continue it
+    struct Snapshot {
+        long long roundsDone;
+        RoundResult totals;
+        string state; // Blackjack::saveState() bytes
+    };
+
+    struct Table {
+        int id;
+        int seats;
+        Blackjack game;
+        long long roundsTarget;
+        long long roundsLeft; // Only touched by the task that owns the table
+        RoundResult totals; // Running totals, also only touched by the owning task
+        SpscQueue<RoundResult, 4096> results;
+        atomic<bool> done;
+
+        Snapshot buffers[3];
+        int back; // Buffer the table writes next
+        int front; // Buffer the aggregator read last
+        atomic<int> middle; // Buffer in between, bit 4 set when it holds a newer snapshot
+
+        Table(int i, int s)
+            : id(i), seats(s), game(s), roundsTarget(0), roundsLeft(0),
+              totals{i, 0, 0, 0, 0}, done(false), back(0), front(1), middle(2) {
+            game.setRecordGraph(false);
+        }
+
+        // Writer side: fill the back buffer and swap it into the middle
+        void publish() {
+            Snapshot& snap = buffers[back];
+            snap.roundsDone = roundsTarget - roundsLeft;
+            snap.totals = totals;
+            ostringstream out;
+            game.saveState(out);
+            snap.state = out.str();
+            back = middle.exchange(back | 4, memory_order_acq_rel) & 3;
+        }
+
+        // Reader side: take the newest snapshot if there is one
+        const Snapshot& latest() {
+            if (middle.load(memory_order_acquire) & 4) {
+                front = middle.exchange(front, memory_order_acq_rel) & 3;
+            }
+            return buffers[front];
+        }
+    };
+
+    vector<unique_ptr<Table>> tables;
+    string checkpointPath;
+    double checkpointSeconds;
+
+    // Play rounds until the batch is done or the queue is full, then requeue
+    void playBatch(WorkStealingPool& pool, Table& table) {
+        for (int r = 0; r < roundsPerTask && table.roundsLeft > 0; r++) {
+            if (table.results.full()) break; // Aggregator is behind, try again later
+            RoundResult result = table.game.simulateRound();
+            result.table = table.id;
+            table.results.push(result);
+            table.totals.hands += result.hands;
+            table.totals.playerWins += result.playerWins;
+            table.totals.dealerWins += result.dealerWins;
+            table.totals.ties += result.ties;
+            table.roundsLeft--;
+        }
+        if (!checkpointPath.empty()) {
+            table.publish();
+        }
+        if (table.roundsLeft > 0) {
+            pool.submit([this, &pool, &table]() { playBatch(pool, table); });
+        } else {
+            table.done.store(true, memory_order_release);
+        }
+    }
+
+    // Write the latest snapshot of every table, through a temporary file so a
+    // crash while writing never leaves a broken checkpoint behind
+    void writeCheckpoint() {
+        string tempPath = checkpointPath + ".tmp";
+        {
+            ofstream out(tempPath, ios::binary);
+            writeValue(out, checkpointMagic);
+            writeValue(out, checkpointVersion);
+            writeValue(out, static_cast<uint32_t>(tables.size()));
+            for (auto& table : tables) {
+                const Snapshot& snap = table->latest();
+                writeValue(out, static_cast<int32_t>(table->seats));
+                writeValue(out, snap.roundsDone);
+                writeValue(out, snap.totals.hands);
+                writeValue(out, snap.totals.playerWins);
+                writeValue(out, snap.totals.dealerWins);
+                writeValue(out, snap.totals.ties);
+                writeString(out, snap.state);
+            }
+            if (!out) {
+                cout << "Could not write checkpoint " << tempPath << endl;
+                return;
+            }
+        }
+        rename(tempPath.c_str(), checkpointPath.c_str());
+    }
+
+public:
+    // copies repeats the four menu tables to test scaling with table count
+    // Table n's deck is seeded with seed + n
+    Casino(int copies, uint32_t seed) : checkpointSeconds(0) {
+        int seats[4] = {3, 1, 5, 2};
+        for (int c = 0; c < copies; c++) {
+            for (int t = 0; t < 4; t++) {
+                int id = static_cast<int>(tables.size());
+                tables.push_back(unique_ptr<Table>(new Table(id, seats[t])));
+                tables.back()->game.seed(seed + id);
+            }
+        }
+    }
+
+    // Write a checkpoint to path every seconds while running
+    void setCheckpoint(const string& path, double seconds) {
+        checkpointPath = path;
+        checkpointSeconds = seconds;
+    }
+
+    // Continue from a checkpoint written by a casino with the same tables
+    bool resume(const string& path) {
+        ifstream in(path, ios::binary);
+        uint32_t magic, version, count;
+        if (!readValue(in, magic) || magic != checkpointMagic || !readValue(in, version) ||
+            version != checkpointVersion || !readValue(in, count) || count != tables.size()) {
+            return false;
+        }
+        for (auto& table : tables) {
+            int32_t seats;
+            long long roundsDone;
+            RoundResult totals = {table->id, 0, 0, 0, 0};
+            string state;
+            if (!readValue(in, seats) || seats != table->seats || !readValue(in, roundsDone) ||
+                !readValue(in, totals.hands) || !readValue(in, totals.playerWins) ||
+                !readValue(in, totals.dealerWins) || !readValue(in, totals.ties) || !readString(in, state)) {
+                return false;
+            }
+            istringstream stateIn(state);
+            if (!table->game.loadState(stateIn)) return false;
+            table->roundsTarget = roundsDone; // run() adds the rounds still to play
+            table->totals = totals;
+        }
+        return true;
+    }
+
+    // Play every table up to rounds rounds on threads workers and print the totals
+    void run(long long rounds, int threads) {
+        vector<RoundResult> totals;
+        long long resumedHands = 0;
+        for (auto& table : tables) {
+            totals.push_back(table->totals); // Non zero when resuming
+            resumedHands += table->totals.hands;
+            table->roundsLeft = max(rounds - table->roundsTarget, 0LL);
+            table->roundsTarget = rounds;
+            if (!checkpointPath.empty()) {
+                table->publish();
+            }
+        }
+
+        auto start = chrono::steady_clock::now();
+        auto lastCheckpoint = start;
+        {
+            WorkStealingPool pool(threads);
+            for (auto& table : tables) {
+                Table* t = table.get();
+                pool.submit([this, &pool, t]() { playBatch(pool, *t); }, t->id);
+            }
+
+            // Aggregate until every table is finished and its queue is empty
+            size_t finished = 0;
+            while (finished < tables.size()) {
+                finished = 0;
+                for (auto& table : tables) {
+                    bool done = table->done.load(memory_order_acquire);
+                    RoundResult result;
+                    while (table->results.pop(result)) {
+                        RoundResult& total = totals[result.table];
+                        total.hands += result.hands;
+                        total.playerWins += result.playerWins;
+                        total.dealerWins += result.dealerWins;
+                        total.ties += result.ties;
+                    }
+                    if (done) finished++;
+                }
+                auto now = chrono::steady_clock::now();
+                if (!checkpointPath.empty() &&
+                    chrono::duration<double>(now - lastCheckpoint).count() >= checkpointSeconds) {
+                    writeCheckpoint();
+                    lastCheckpoint = now;
+                }
+                if (finished < tables.size()) this_thread::yield();
+            }
+        }
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        if (!checkpointPath.empty()) {
+            writeCheckpoint();
+        }
+
+        long long hands = 0;
+        for (size_t i = 0; i < tables.size(); i++) {
+            const RoundResult& total = totals[i];
+            cout << "Table " << (i + 1) << " (" << tables[i]->seats << " players): "
+                 << total.hands << " hands, players won " << total.playerWins
+                 << ", dealer won " << total.dealerWins << ", ties " << total.ties << endl;
+            hands += total.hands;
+        }
+        cout << tables.size() << " tables on " << threads << " threads: " << hands - resumedHands
+             << " hands in " << fixed << setprecision(2) << seconds << "s (" << setprecision(0)
+             << (hands - resumedHands) / seconds << " hands/sec)" << endl;
+    }
+};
+
+// Running mean and variance using Welford's method, stable for billions of samples
+struct RunningStat {
+    long long count;
+    double mean;
+    double m2; // Sum of squared distances from the mean
+
+    RunningStat() : count(0), mean(0), m2(0) {}
+
+    void add(double x) {
+        count++;
+        double delta = x - mean;
+        mean += delta / count;
+        m2 += delta * (x - mean);
+    }
+
+    double variance() const {
+        return count > 1 ? m2 / (count - 1) : 0;
+    }
+
+    // Half width of the 95% confidence interval of the mean
+    double halfWidth() const {
+        return count > 1 ? 1.96 * sqrt(variance() / count) : INFINITY;
+    }
+
+    // Combine with another accumulator (Chan et al.), as if all samples were added here
+    void merge(const RunningStat& other) {
+        if (other.count == 0) return;
+        long long total = count + other.count;
+        double delta = other.mean - mean;
+        mean += delta * other.count / total;
+        m2 += other.m2 + delta * delta * count * other.count / total;
+        count = total;
+    }
+};
+
+// StrategyComparison plays two policies on the same shoes (common random numbers)
+// Round n of both policies starts from a deck seeded with seed + n, so they see the
+// same deal and the same hit cards until their decisions differ. The paired
+// difference of the two results has far less variance than two separate runs.
+// With antithetic shoes every seed is also played on its rank mirrored shoe and
+// the two paired differences are averaged into one sample.
+class StrategyComparison {
+private:
+    Deck deck;
+    Hand player;
+    Hand dealer;
+
+    // One seat against the Blackjack2 dealer with policy deciding every hit
+    int playRound(const DecisionTree& policy) {
+        player.clear();
+        dealer.clear();
+        player.addCard(deck.deal());
+        dealer.addCard(deck.deal());
+        player.addCard(deck.deal());
+        dealer.addCard(deck.deal());
+        int upCard = dealer.getCard(0).getValue();
+        while (!player.isBlackjack() && policy.shouldHit(player.getValue(), upCard, player.isSoft())) {
+            player.addCard(deck.deal());
+        }
+        if (!player.isBust()) {
+            while (dealer.getValue() < 17 && dealer.getValue() <= player.getValue()) {
+                dealer.addCard(deck.deal());
+            }
+        }
+        return roundReward(player, dealer);
+    }
+
+    // Both policies on one shoe, returns A minus B
+    double pairedRound(const DecisionTree& a, const DecisionTree& b, uint32_t shoe, bool antithetic,
+                       RunningStat& statA, RunningStat& statB) {
+        deck.seed(shoe, antithetic);
+        int resultA = playRound(a);
+        deck.seed(shoe, antithetic);
+        int resultB = playRound(b);
+        statA.add(resultA);
+        statB.add(resultB);
+        return resultA - resultB;
+    }
+
+public:
+    // Compare a and b over rounds shoes and print both edges and the paired difference
+    void run(const DecisionTree& a, const DecisionTree& b, long long rounds, uint32_t seed, bool antithetic) {
+        RunningStat statA, statB, difference;
+        for (long long r = 0; r < rounds; r++) {
+            uint32_t shoe = seed + static_cast<uint32_t>(r);
+            double d = pairedRound(a, b, shoe, false, statA, statB);
+            if (antithetic) {
+                d = (d + pairedRound(a, b, shoe, true, statA, statB)) / 2;
+            }
+            difference.add(d);
+        }
+
+        // Without pairing the difference of the means would have the variance of both
+        double independent = 1.96 * sqrt(statA.variance() / statA.count + statB.variance() / statB.count);
+        cout << fixed << setprecision(4);
+        cout << "Policy A: " << statA.mean << " +/- " << statA.halfWidth() << " per hand over "
+             << statA.count << " hands" << endl;
+        cout << "Policy B: " << statB.mean << " +/- " << statB.halfWidth() << " per hand over "
+             << statB.count << " hands" << endl;
+        cout << "A - B: " << difference.mean << " +/- " << difference.halfWidth()
+             << " (95% CI, " << (antithetic ? "common random numbers + antithetic shoes" : "common random numbers")
+             << ")" << endl;
+        cout << "Independent runs would give +/- " << independent << ", "
+             << setprecision(1) << (independent * independent) / (difference.halfWidth() * difference.halfWidth())
+             << "x the hands for the same width" << endl;
+    }
+};
+
+// AdaptiveSimulation plays one table on several threads until the per-seat return
+// is known well enough. Every thread keeps its own Welford accumulator per seat and
+// copies it into a shared slot after each batch. The main thread merges the slots a
+// few times a second and stops everyone once every seat's 95% confidence interval
+// is narrower than the target, instead of running a fixed number of hands.
+class AdaptiveSimulation {
+private:
+    static constexpr int roundsPerBatch = 1024;
+
+    struct Slot {
+        mutex lock;
+        vector<RunningStat> seats; // Copy of the thread's accumulators
+    };
+
+    int seats;
+    vector<unique_ptr<Slot>> slots;
+    atomic<bool> stopping;
+
+    void worker(int index, uint32_t seed) {
+        Blackjack game(seats);
+        game.setRecordGraph(false);
+        game.seed(seed);
+        vector<RunningStat> local(seats);
+        while (!stopping.load(memory_order_relaxed)) {
+            for (int r = 0; r < roundsPerBatch; r++) {
+                game.simulateRound();
+                for (int s = 0; s < seats; s++) {
+                    local[s].add(game.seatReward(s));
+                }
+            }
+            lock_guard<mutex> guard(slots[index]->lock);
+            slots[index]->seats = local;
+        }
+    }
+
+public:
+    explicit AdaptiveSimulation(int numSeats) : seats(numSeats), stopping(false) {}
+
+    // Run until every seat's interval half width is at most target or maxHands per seat
+    void run(double target, long long maxHands, int threads, uint32_t seed) {
+        slots.clear();
+        for (int t = 0; t < threads; t++) {
+            slots.push_back(unique_ptr<Slot>(new Slot()));
+            slots.back()->seats.resize(seats);
+        }
+        stopping.store(false);
+        auto start = chrono::steady_clock::now();
+        vector<thread> workers;
+        for (int t = 0; t < threads; t++) {
+            workers.emplace_back([this, t, seed]() { worker(t, seed + t); });
+        }
+
+        vector<RunningStat> merged;
+        bool converged = false;
+        while (true) {
+            this_thread::sleep_for(chrono::milliseconds(50));
+            merged.assign(seats, RunningStat());
+            for (auto& slot : slots) {
+                lock_guard<mutex> guard(slot->lock);
+                for (int s = 0; s < seats; s++) {
+                    merged[s].merge(slot->seats[s]);
+                }
+            }
+            double widest = 0;
+            for (const auto& stat : merged) {
+                widest = max(widest, stat.halfWidth());
+            }
+            converged = widest <= target;
+            if (converged || merged[0].count >= maxHands) break;
+        }
+        stopping.store(true);
+        for (auto& w : workers) {
+            w.join();
+        }
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+        cout << fixed << setprecision(4);
+        for (int s = 0; s < seats; s++) {
+            cout << "Player " << (s + 1) << ": " << merged[s].mean << " +/- " << merged[s].halfWidth()
+                 << " per hand over " << merged[s].count << " hands" << endl;
+        }
+        cout << (converged ? "Reached" : "Stopped at the hand limit before reaching")
+             << " +/- " << target << " in " << setprecision(2) << seconds << "s on "
+             << threads << " threads" << endl;
+    }
+};
+
+// TransitionModel is a Markov chain over the round results of one seat
+// Each round is binned like a GameGraph node: the player's total (bust, under 17 or
+// 17-21), the dealer's total (the same bins) and the outcome, in 7 * 7 * 3 state
+// indices. Only totals and outcomes that can happen together are states, and the
+// counts of round n -> round n + 1 are a dense row-major table over those states.
+// Threads count in a private Tally and add it to the shared counts in place with
+// relaxed atomic adds once per batch. probabilities() keeps only the transitions
+// that were seen, as a CSR matrix that the chain analytics step through.
+class TransitionModel {
+public:
+    static constexpr int numBins = 7; // Bust, under 17, 17, 18, 19, 20, 21
+    static constexpr int numStates = numBins * numBins * 3;
+
+    // Counts in the same order as the shared table, private to one thread
+    typedef vector<uint64_t> Tally;
+
+    // Row normalized probabilities of the nonzero transitions, rows never left are empty
+    struct Chain {
+        vector<uint32_t> rowStart; // numStates + 1 offsets into columns
+        vector<uint16_t> columns; // Target state of each entry, sorted within a row
+        vector<double> p; // Probability of each entry
+    };
+
+private:
+    vector<int16_t> denseIndex; // Row and column of each state in the table, -1 if impossible
+    vector<uint16_t> stateAt; // State of each table row and column
+    unique_ptr<atomic<uint64_t>[]> counts; // stateAt.size() squared, row major by the from state
+
+    static int bin(int total) {
+        return total > 21 ? 0 : total < 17 ? 1 : total - 15;
+    }
+
+    // Same order of checks as roundReward(), with Blackjack as a total of 21
+    static int reward(int player, int dealer) {
+        if (player > 21) return -1;
+        if (dealer > 21) return 1;
+        if (player == 21 && dealer != 21) return 1;
+        if (dealer == 21 && player != 21) return -1;
+        return player > dealer ? 1 : player < dealer ? -1 : 0;
+    }
+
+    size_t cell(int from, int to) const {
+        return static_cast<size_t>(denseIndex[from]) * stateAt.size() + denseIndex[to];
+    }
+
+public:
+    TransitionModel() : denseIndex(numStates, -1) {
+        for (int player = 4; player <= 30; player++) {
+            for (int dealer = 2; dealer <= 26; dealer++) {
+                denseIndex[stateOf(player, dealer)] = 0;
+            }
+        }
+        for (int state = 0; state < numStates; state++) {
+            if (denseIndex[state] < 0) continue;
+            denseIndex[state] = static_cast<int16_t>(stateAt.size());
+            stateAt.push_back(static_cast<uint16_t>(state));
+        }
+        counts.reset(new atomic<uint64_t>[entries()]);
+        clear();
+    }
+
+    // State of a seat from its final total and the dealer's
+    static int stateOf(int player, int dealer) {
+        return ((reward(player, dealer) + 1) * numBins + bin(player)) * numBins + bin(dealer);
+    }
+
+    // Outcome of a state: 1 win, 0 tie, -1 loss
+    static int outcomeOf(int state) {
+        return state / (numBins * numBins) - 1;
+    }
+
+    static string describe(int state) {
+        const char* names[numBins] = {"bust", "<17", "17", "18", "19", "20", "21"};
+        const char* outcomes[3] = {"loss", "tie", "win"};
+        return string("player ") + names[state / numBins % numBins] + ", dealer " + names[state % numBins]
+             + ", " + outcomes[state / (numBins * numBins)];
+    }
+
+    int states() const {
+        return static_cast<int>(stateAt.size());
+    }
+
+    // Cells in the count table, one for every pair of states
+    size_t entries() const {
+        return stateAt.size() * stateAt.size();
+    }
+
+    void clear() {
+        for (size_t i = 0; i < entries(); i++) {
+            counts[i].store(0, memory_order_relaxed);
+        }
+    }
+
+    Tally newTally() const {
+        return Tally(entries(), 0);
+    }
+
+    // Count one round to round step in a thread's tally
+    void record(Tally& tally, int from, int to) const {
+        tally[cell(from, to)]++;
+    }
+
+    // Add a thread's tally to the shared counts and empty it, safe from any thread
+    void merge(Tally& tally) {
+        for (size_t i = 0; i < tally.size(); i++) {
+            if (tally[i] != 0) counts[i].fetch_add(tally[i], memory_order_relaxed);
+        }
+        fill(tally.begin(), tally.end(), 0);
+    }
+
+    uint64_t transitions() const {
+        uint64_t total = 0;
+        for (size_t i = 0; i < entries(); i++) {
+            total += counts[i].load(memory_order_relaxed);
+        }
+        return total;
+    }
+
+    // The seen transitions of every row, normalized by the row's total
+    Chain probabilities() const {
+        Chain chain;
+        chain.rowStart.assign(1, 0);
+        for (int from = 0; from < numStates; from++) {
+            if (denseIndex[from] >= 0) {
+                uint64_t total = 0;
+                for (size_t to = 0; to < stateAt.size(); to++) {
+                    total += counts[denseIndex[from] * stateAt.size() + to].load(memory_order_relaxed);
+                }
+                for (size_t to = 0; to < stateAt.size(); to++) {
+                    uint64_t seen = counts[denseIndex[from] * stateAt.size() + to].load(memory_order_relaxed);
+                    if (seen == 0) continue;
+                    chain.columns.push_back(stateAt[to]);
+                    chain.p.push_back(static_cast<double>(seen) / total);
+                }
+            }
+            chain.rowStart.push_back(static_cast<uint32_t>(chain.columns.size()));
+        }
+        return chain;
+    }
+
+    // One step of the chain: next = current * P
+    void step(const Chain& chain, const vector<double>& current, vector<double>& next) const {
+        fill(next.begin(), next.end(), 0.0);
+        for (int from = 0; from < numStates; from++) {
+            if (current[from] == 0) continue;
+            for (uint32_t e = chain.rowStart[from]; e < chain.rowStart[from + 1]; e++) {
+                next[chain.columns[e]] += current[from] * chain.p[e];
+            }
+        }
+    }
+
+    // Long run share of rounds in each state, by power iteration from uniform
+    vector<double> stationary(const Chain& p, int maxIterations = 10000) const {
+        vector<double> current(numStates, 0.0);
+        vector<double> next(numStates);
+        for (int s : stateAt) {
+            current[s] = 1.0 / states();
+        }
+        for (int i = 0; i < maxIterations; i++) {
+            step(p, current, next);
+            double total = accumulate(next.begin(), next.end(), 0.0);
+            double change = 0;
+            for (int s = 0; s < numStates; s++) {
+                next[s] = total > 0 ? next[s] / total : 0.0;
+                change += fabs(next[s] - current[s]);
+            }
+            current.swap(next);
+            if (change < 1e-13) break;
+        }
+        return current;
+    }
+
+    // Chance that length rounds in a row, starting from the long run mix, all have
+    // the given outcome: keep only the outcome's states after every step
+    double streakProbability(const Chain& p, const vector<double>& start, int outcome, int length) const {
+        vector<double> current(start);
+        vector<double> next(numStates);
+        for (int i = 0; i < length; i++) {
+            if (i > 0) {
+                step(p, current, next);
+                current.swap(next);
+            }
+            for (int s = 0; s < numStates; s++) {
+                if (outcomeOf(s) != outcome) current[s] = 0;
+            }
+        }
+        return accumulate(current.begin(), current.end(), 0.0);
+    }
+};
+
+// MarkovSimulation plays one table on several threads and counts every seat's round
+// to round transitions into a TransitionModel, then prints its long run analytics
+class MarkovSimulation {
+private:
+    static constexpr int roundsPerBatch = 4096;
+
+    int seats;
+    TransitionModel model;
+
+    void worker(long long rounds, uint32_t seed) {
+        Blackjack game(seats);
+        game.setRecordGraph(false);
+        game.seed(seed);
+        TransitionModel::Tally tally = model.newTally();
+        vector<int> previous(seats, -1);
+        for (long long r = 0; r < rounds; r++) {
+            game.simulateRound();
+            for (int s = 0; s < seats; s++) {
+                int state = TransitionModel::stateOf(game.seatValue(s), game.dealerValue());
+                if (previous[s] >= 0) model.record(tally, previous[s], state);
+                previous[s] = state;
+            }
+            if ((r + 1) % roundsPerBatch == 0) model.merge(tally);
+        }
+        model.merge(tally);
+    }
+
+public:
+    explicit MarkovSimulation(int numSeats) : seats(numSeats) {}
+
+    void run(long long rounds, int threads, uint32_t seed) {
+        model.clear();
+        auto start = chrono::steady_clock::now();
+        vector<thread> workers;
+        for (int t = 0; t < threads; t++) {
+            long long share = rounds / threads + (t < rounds % threads ? 1 : 0);
+            workers.emplace_back([this, share, seed, t]() { worker(share, seed + t); });
+        }
+        for (auto& w : workers) {
+            w.join();
+        }
+        double simulated = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+        start = chrono::steady_clock::now();
+        TransitionModel::Chain p = model.probabilities();
+        vector<double> longRun = model.stationary(p);
+        double streaks[2][10];
+        for (int k = 1; k <= 9; k++) {
+            streaks[0][k] = model.streakProbability(p, longRun, -1, k);
+            streaks[1][k] = model.streakProbability(p, longRun, 1, k);
+        }
+        double analyzed = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+        cout << model.transitions() << " transitions between " << model.states() << " states ("
+             << p.columns.size() << " of " << model.entries() << " transitions seen) counted in " << fixed << setprecision(2)
+             << simulated << "s on " << threads << " threads" << endl;
+
+        vector<int> order;
+        double outcomeShare[3] = {0, 0, 0};
+        for (int s = 0; s < TransitionModel::numStates; s++) {
+            outcomeShare[TransitionModel::outcomeOf(s) + 1] += longRun[s];
+            if (longRun[s] > 0) order.push_back(s);
+        }
+        sort(order.begin(), order.end(), [&longRun](int a, int b) { return longRun[a] > longRun[b]; });
+        cout << "Most common states in the long run:" << endl;
+        cout << setprecision(4);
+        for (size_t i = 0; i < order.size() && i < 8; i++) {
+            cout << "  " << setw(7) << longRun[order[i]] * 100 << "%  " << TransitionModel::describe(order[i]) << endl;
+        }
+        cout << "Long run outcomes: win " << outcomeShare[2] * 100 << "%, tie " << outcomeShare[1] * 100
+             << "%, loss " << outcomeShare[0] * 100 << "%" << endl;
+        cout << "Streak  P(losses)  P(next loss)  P(wins)  P(next win)" << endl;
+        for (int k = 1; k <= 8; k++) {
+            cout << setw(6) << k << setw(11) << streaks[0][k] << setw(14)
+                 << (streaks[0][k] > 0 ? streaks[0][k + 1] / streaks[0][k] : 0.0)
+                 << setw(9) << streaks[1][k] << setw(13)
+                 << (streaks[1][k] > 0 ? streaks[1][k + 1] / streaks[1][k] : 0.0) << endl;
+        }
+        cout << "Analytics took " << setprecision(3) << analyzed << " ms" << endl;
+    }
+};
+
+// StrategyTrainer learns the computer players' hit/stand tree from simulated rounds
+// Each round is one seat against the dealer (Blackjack2 rule unless told otherwise). The first decision of the hand is made
+// at random and every later one follows the current tree, and the win/tie/loss of
+// the round is credited to that first (total, soft, up card, action) pair.
+// After each pass the better action for every state becomes the new tree.
+class StrategyTrainer {
+private:
+    // Decision states: totals 4-21, hard or soft, dealer up card 1-10 (Ace is 1)
+    static constexpr int numTotals = 18;
+    static constexpr int numUpCards = 10;
+    static constexpr int numStates = numTotals * 2 * numUpCards;
+    static constexpr int minSamples = 200; // Fewer samples than this leaves a state undecided
+
+    // Per state sums for stand (0) and hit (1)
+    struct Tally {
+        long long count[2];
+        long long reward[2];
+    };
+
+    DecisionTree tree;
+    vector<int> decision; // Per state 1 hit, 0 stand, -1 unknown
+    DealerRule rule; // Dealer the strategy is trained against
+
+    static int stateIndex(int total, bool soft, int upCard) {
+        return ((total - 4) * 2 + (soft ? 1 : 0)) * numUpCards + (upCard - 1);
+    }
+
+    // Play rounds for one thread and add the outcomes to tally
+    void simulate(long long rounds, vector<Tally>& tally) const {
+        Deck deck;
+        Hand player;
+        Hand dealer;
+        mt19937 rng(random_device{}());
+        for (long long r = 0; r < rounds; r++) {
+            player.clear();
+            dealer.clear();
+            player.addCard(deck.deal());
+            dealer.addCard(deck.deal());
+            player.addCard(deck.deal());
+            dealer.addCard(deck.deal());
+            if (player.isBlackjack()) continue; // No decision to learn from
+
+            int upCard = dealer.getCard(0).getValue();
+            int state = stateIndex(player.getValue(), player.isSoft(), upCard);
+            int action = rng() & 1;
+            if (action == 1) {
+                player.addCard(deck.deal());
+                while (!player.isBlackjack() && tree.shouldHit(player.getValue(), upCard, player.isSoft())) {
+                    player.addCard(deck.deal());
+                }
+            }
+
+            if (!player.isBust()) {
+                while (dealerHits(rule, dealer.getValue(), player.getValue())) {
+                    dealer.addCard(deck.deal());
+                }
+            }
+
+            int reward = roundReward(player, dealer);
+            tally[state].count[action]++;
+            tally[state].reward[action] += reward;
+        }
+    }
+
+    // Decision of one grid cell, -1 when it was never seen
+    int cell(int total, int soft, int upCard) const {
+        return decision[stateIndex(total, soft != 0, upCard)];
+    }
+
+    // Count hit and stand cells in a box of the grid
+    void countBox(const int lo[3], const int hi[3], int& hits, int& stands) const {
+        hits = stands = 0;
+        for (int t = lo[0]; t <= hi[0]; t++)
+            for (int u = lo[1]; u <= hi[1]; u++)
+                for (int f = lo[2]; f <= hi[2]; f++) {
+                    int d = cell(t, f, u);
+                    if (d == 1) hits++;
+                    else if (d == 0) stands++;
+                }
+    }
+
+    // Build the subtree for a box of (total, up card, soft), splitting where the
+    // fewest cells end up on the wrong side until every box agrees
+    uint32_t buildBox(DecisionTree& out, const int lo[3], const int hi[3],
+                      uint32_t hitLeaf, uint32_t standLeaf) const {
+        int hits, stands;
+        countBox(lo, hi, hits, stands);
+        if (stands == 0) return hitLeaf;
+        if (hits == 0) return standLeaf;
+
+        int bestFeature = -1, bestThreshold = 0, bestError = INT32_MAX;
+        for (int f = 0; f < 3; f++) {
+            for (int t = lo[f]; t < hi[f]; t++) {
+                int leftHi[3] = {hi[0], hi[1], hi[2]};
+                int rightLo[3] = {lo[0], lo[1], lo[2]};
+                leftHi[f] = t;
+                rightLo[f] = t + 1;
+                int lh, ls, rh, rs;
+                countBox(lo, leftHi, lh, ls);
+                countBox(rightLo, hi, rh, rs);
+                int error = min(lh, ls) + min(rh, rs);
+                if (error < bestError) {
+                    bestError = error;
+                    bestFeature = f;
+                    bestThreshold = t;
+                }
+            }
+        }
+
+        int leftHi[3] = {hi[0], hi[1], hi[2]};
+        int rightLo[3] = {lo[0], lo[1], lo[2]};
+        leftHi[bestFeature] = bestThreshold;
+        rightLo[bestFeature] = bestThreshold + 1;
+        uint32_t left = buildBox(out, lo, leftHi, hitLeaf, standLeaf);
+        uint32_t right = buildBox(out, rightLo, hi, hitLeaf, standLeaf);
+        DecisionTree::Feature features[3] = {DecisionTree::HandValue, DecisionTree::DealerUpCard, DecisionTree::Soft};
+        return out.addSplit(features[bestFeature], bestThreshold, left, right);
+    }
+
+public:
+    explicit StrategyTrainer(DealerRule dealerRule = HitBelow17UnlessAhead)
+        : decision(numStates, -1), rule(dealerRule) {}
+
+    // Run rounds simulated rounds per pass spread over threads, then rebuild the tree
+    void train(long long rounds, int passes, int threads, bool quiet = false) {
+        for (int pass = 0; pass < passes; pass++) {
+            vector<vector<Tally>> tallies(threads, vector<Tally>(numStates, Tally{{0, 0}, {0, 0}}));
+            vector<thread> workers;
+            auto start = chrono::steady_clock::now();
+            for (int t = 0; t < threads; t++) {
+                long long share = rounds / threads + (t < rounds % threads ? 1 : 0);
+                workers.emplace_back([this, share, &tallies, t]() { simulate(share, tallies[t]); });
+            }
+            for (auto& worker : workers) {
+                worker.join();
+            }
+            double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+            // Merge the per thread tallies and pick the better action in each state
+            for (int s = 0; s < numStates; s++) {
+                Tally total = {{0, 0}, {0, 0}};
+                for (const auto& tally : tallies) {
+                    for (int a = 0; a < 2; a++) {
+                        total.count[a] += tally[s].count[a];
+                        total.reward[a] += tally[s].reward[a];
+                    }
+                }
+                if (total.count[0] < minSamples || total.count[1] < minSamples) continue;
+                double standValue = static_cast<double>(total.reward[0]) / total.count[0];
+                double hitValue = static_cast<double>(total.reward[1]) / total.count[1];
+                decision[s] = hitValue > standValue ? 1 : 0;
+            }
+
+            // Cells never seen fall back to the tree that generated this pass
+            for (int t = 4; t <= 21; t++)
+                for (int f = 0; f < 2; f++)
+                    for (int u = 1; u <= numUpCards; u++) {
+                        int& d = decision[stateIndex(t, f != 0, u)];
+                        if (d == -1) d = tree.shouldHit(t, u, f != 0) ? 1 : 0;
+                    }
+
+            DecisionTree next;
+            next.clear();
+            uint32_t hitLeaf = next.addLeaf(true);
+            uint32_t standLeaf = next.addLeaf(false);
+            int lo[3] = {4, 1, 0};
+            int hi[3] = {21, numUpCards, 1};
+            next.setRoot(buildBox(next, lo, hi, hitLeaf, standLeaf));
+            tree = next;
+
+            if (quiet) continue;
+            cout << "Pass " << (pass + 1) << ": " << rounds << " rounds on " << threads
+                 << " threads in " << fixed << setprecision(2) << seconds << "s ("
+                 << setprecision(0) << rounds / seconds << " rounds/sec), tree has "
+                 << tree.size() << " nodes" << endl;
+        }
+    }
+
+    const DecisionTree& getTree() const {
+        return tree;
+    }
+
+    // Print the learned hit (H) / stand (S) chart, rows are totals and columns up cards
+    void printChart() const {
+        for (int f = 0; f < 2; f++) {
+            cout << (f ? "Soft" : "Hard") << " totals vs dealer A 2 3 4 5 6 7 8 9 10" << endl;
+            for (int t = (f ? 12 : 4); t <= 21; t++) {
+                cout << setw(2) << t << ":                ";
+                for (int u = 1; u <= numUpCards; u++) {
+                    cout << " " << (tree.shouldHit(t, u, f != 0) ? 'H' : 'S');
+                }
+                cout << endl;
+            }
+        }
+    }
+};
+
+// ExactRound computes the exact expected return of one seat for one round dealt
+// from a known set of remaining cards, by walking every card sequence instead of
+// sampling. Order of play follows the game: player, dealer up card, player, dealer
+// hole card, player hits under the policy, then the dealer draws by its rule.
+// Only card values matter, so states are (remaining counts, stage, both hands) and
+// each state's value is memoized. A bust player is settled without enumerating the
+// dealer. The first card's ten branches run on separate threads with their own memo.
+class ExactRound {
+private:
+    // Stages of the round, in dealing order
+    enum Stage {
+        PlayerFirst, DealerUp, PlayerSecond, DealerHole, PlayerTurn, DealerTurn
+    };
+
+    struct Key {
+        uint64_t counts; // Six bits per card value 1-10
+        uint32_t state; // Stage and both hands
+
+        bool operator==(const Key& other) const {
+            return counts == other.counts && state == other.state;
+        }
+    };
+
+    struct KeyHash {
+        size_t operator()(const Key& key) const {
+            return hash<uint64_t>()(key.counts * 31 + key.state);
+        }
+    };
+
+    // A hand is its hard total (aces as 1) plus whether it holds an ace
+    static int total(int hard, bool ace) {
+        return ace && hard <= 11 ? hard + 10 : hard;
+    }
+
+    static bool soft(int hard, bool ace) {
+        return ace && hard <= 11;
+    }
+
+    const DecisionTree& policy;
+    DealerRule rule;
+
+    // One branch's search, each thread owns one
+    struct Search {
+        const ExactRound& round;
+        int counts[11];
+        int cardsLeft;
+        unordered_map<Key, double, KeyHash> memo;
+
+        explicit Search(const ExactRound& r) : round(r), cardsLeft(0) {}
+
+        Key key(int stage, int pHard, bool pAce, int dHard, bool dAce, int up) const {
+            uint64_t packed = 0;
+            for (int v = 1; v <= 10; v++) {
+                packed |= static_cast<uint64_t>(counts[v]) << (6 * (v - 1));
+            }
+            uint32_t state = static_cast<uint32_t>(stage) | (pHard << 3) | (pAce << 8) |
+                             (dHard << 9) | (dAce << 14) | (up << 15);
+            return Key{packed, state};
+        }
+
+        // Average value over the next card, each value weighted by how many are left
+        template <typename Next>
+        double drawAverage(Next next) {
+            double sum = 0;
+            int left = cardsLeft;
+            for (int v = 1; v <= 10; v++) {
+                if (counts[v] == 0) continue;
+                double weight = static_cast<double>(counts[v]) / left;
+                counts[v]--;
+                cardsLeft--;
+                sum += weight * next(v);
+                counts[v]++;
+                cardsLeft++;
+            }
+            return sum;
+        }
+
+        // Expected return from this point on
+        double value(int stage, int pHard, bool pAce, int dHard, bool dAce, int up) {
+            int player = total(pHard, pAce);
+            if (stage == PlayerTurn && player > 21) return -1; // Bust, dealer does not play
+            if (stage == DealerTurn && player > 21) return -1;
+
+            Key k = key(stage, pHard, pAce, dHard, dAce, up);
+            auto it = memo.find(k);
+            if (it != memo.end()) return it->second;
+
+            double result;
+            int dealer = total(dHard, dAce);
+            if (cardsLeft == 0 && stage < PlayerTurn) {
+                result = 0; // Not enough cards for a round
+            } else if (stage == PlayerFirst) {
+                result = drawAverage([&](int v) { return value(DealerUp, v, v == 1, 0, false, 0); });
+            } else if (stage == DealerUp) {
+                result = drawAverage([&](int v) { return value(PlayerSecond, pHard, pAce, v, v == 1, v); });
+            } else if (stage == PlayerSecond) {
+                result = drawAverage([&](int v) { return value(DealerHole, pHard + v, pAce || v == 1, dHard, dAce, up); });
+            } else if (stage == DealerHole) {
+                result = drawAverage([&](int v) { return value(PlayerTurn, pHard, pAce, dHard + v, dAce || v == 1, up); });
+            } else if (stage == PlayerTurn) {
+                bool hit = cardsLeft > 0 && player != 21 &&
+                           round.policy.shouldHit(player, up, soft(pHard, pAce));
+                if (hit) {
+                    result = drawAverage([&](int v) { return value(PlayerTurn, pHard + v, pAce || v == 1, dHard, dAce, up); });
+                } else {
+                    result = value(DealerTurn, pHard, pAce, dHard, dAce, up);
+                }
+            } else if (cardsLeft > 0 && dealerHits(round.rule, dealer, player)) {
+                result = drawAverage([&](int v) { return value(DealerTurn, pHard, pAce, dHard + v, dAce || v == 1, up); });
+            } else {
+                // Same checks as roundReward(), the player is not bust here
+                if (dealer > 21) result = 1;
+                else if (player == 21 && dealer != 21) result = 1;
+                else if (dealer == 21 && player != 21) result = -1;
+                else if (player > dealer) result = 1;
+                else if (player < dealer) result = -1;
+                else result = 0;
+            }
+            memo[k] = result;
+            return result;
+        }
+    };
+
+public:
+    ExactRound(const DecisionTree& tree, DealerRule dealerRule) : policy(tree), rule(dealerRule) {}
+
+    // Exact expected return per round for the remaining cards in counts[1..10]
+    // Returns false if a count is too large for the memo key (over 63 of a value)
+    bool run(const int counts[11], int threads, double& expected, size_t& states) const {
+        int cardsLeft = 0;
+        for (int v = 1; v <= 10; v++) {
+            if (counts[v] < 0 || counts[v] > 63) return false;
+            cardsLeft += counts[v];
+        }
+        expected = 0;
+        states = 0;
+        if (cardsLeft == 0) return true;
+
+        // Each first card value is one branch, handed out to threads in turn
+        double branchValue[11] = {0};
+        size_t branchStates[11] = {0};
+        atomic<int> nextBranch(1);
+        auto work = [&]() {
+            for (int v = nextBranch++; v <= 10; v = nextBranch++) {
+                if (counts[v] == 0) continue;
+                Search search(*this);
+                copy(counts, counts + 11, search.counts);
+                search.counts[v]--;
+                search.cardsLeft = cardsLeft - 1;
+                branchValue[v] = search.value(DealerUp, v, v == 1, 0, false, 0);
+                branchStates[v] = search.memo.size();
+            }
+        };
+        vector<thread> workers;
+        for (int t = 0; t < threads; t++) {
+            workers.emplace_back(work);
+        }
+        for (auto& w : workers) {
+            w.join();
+        }
+        for (int v = 1; v <= 10; v++) {
+            expected += static_cast<double>(counts[v]) / cardsLeft * branchValue[v];
+            states += branchStates[v];
+        }
+        return true;
+    }
+};
+
+// ScenarioSweep plays every combination of dealer rule, seats, decks, penetration
+// and policy as its own job on the work stealing pool and writes one CSV row per cell.
+// Strategy trees are built once per (policy, dealer rule) before the jobs start and
+// shared by every cell that uses them, so a trained policy is only trained once.
+class ScenarioSweep {
+public:
+    struct Cell {
+        DealerRule rule;
+        int seats;
+        int decks;
+        double penetration;
+        string policy;
+        RunningStat edge; // Per hand return over every seat
+        double seconds;
+    };
+
+    vector<DealerRule> rules;
+    vector<int> seats;
+    vector<int> decks;
+    vector<double> penetrations;
+    vector<string> policies;
+    long long trainRounds;
+
+    static string ruleName(DealerRule rule) {
+        if (rule == HitUntilAhead) return "bj1";
+        if (rule == HitBelow17) return "h17";
+        return "bj2";
+    }
+
+    // Dealer rule named by ruleName(), false for any other name
+    static bool parseRule(const string& name, DealerRule& rule) {
+        for (DealerRule candidate : {HitBelow17UnlessAhead, HitUntilAhead, HitBelow17}) {
+            if (name == ruleName(candidate)) {
+                rule = candidate;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static bool isPolicy(const string& name) {
+        return name == "tree" || name == "hit17" || name == "trained";
+    }
+
+private:
+    map<pair<string, int>, DecisionTree> strategyCache;
+
+    // Look up or build the tree for a policy: tree (default), hit17 or trained
+    const DecisionTree& strategyFor(const string& policy, DealerRule rule) {
+        auto key = make_pair(policy, policy == "trained" ? static_cast<int>(rule) : -1);
+        auto it = strategyCache.find(key);
+        if (it != strategyCache.end()) return it->second;
+        DecisionTree tree;
+        if (policy == "hit17") {
+            tree.clear();
+            tree.setRoot(tree.addSplit(DecisionTree::HandValue, 16, tree.addLeaf(true), tree.addLeaf(false)));
+        } else if (policy == "trained") {
+            cout << "Training a strategy for the " << ruleName(rule) << " dealer..." << endl;
+            StrategyTrainer trainer(rule);
+            trainer.train(trainRounds, 4, static_cast<int>(max(1u, thread::hardware_concurrency())), true);
+            tree = trainer.getTree();
+        }
+        return strategyCache[key] = tree;
+    }
+
+    static void playCell(Cell& cell, const DecisionTree& strategy, long long rounds, uint32_t seed) {
+        auto start = chrono::steady_clock::now();
+        Blackjack game(cell.seats);
+        game.setRecordGraph(false);
+        game.setDealerRule(cell.rule);
+        game.setStrategy(strategy);
+        game.setShoe(cell.decks, cell.penetration);
+        game.seed(seed);
+        for (long long r = 0; r < rounds; r++) {
+            game.simulateRound();
+            for (int s = 0; s < cell.seats; s++) {
+                cell.edge.add(game.seatReward(s));
+            }
+        }
+        cell.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    }
+
+public:
+    ScenarioSweep()
+        : rules{HitBelow17UnlessAhead, HitUntilAhead, HitBelow17}, seats{1, 2, 3, 5}, decks{1},
+          penetrations{1.0}, policies{"tree", "hit17"}, trainRounds(500000) {}
+
+    // Play rounds rounds in every cell on threads workers and write the matrix as CSV
+    void run(long long rounds, int threads, uint32_t seed, ostream& out) {
+        vector<Cell> cells;
+        vector<const DecisionTree*> strategies;
+        for (DealerRule rule : rules)
+            for (int s : seats)
+                for (int d : decks)
+                    for (double p : penetrations)
+                        for (const string& policy : policies) {
+                            cells.push_back(Cell{rule, s, d, p, policy, RunningStat(), 0});
+                            strategies.push_back(&strategyFor(policy, rule));
+                        }
+
+        cout << "Sweeping " << cells.size() << " cells of " << rounds << " rounds on "
+             << threads << " threads" << endl;
+        atomic<size_t> finished(0);
+        auto start = chrono::steady_clock::now();
+        {
+            WorkStealingPool pool(threads);
+            for (size_t i = 0; i < cells.size(); i++) {
+                pool.submit([&cells, &strategies, &finished, i, rounds, seed]() {
+                    playCell(cells[i], *strategies[i], rounds, seed + static_cast<uint32_t>(i));
+                    finished.fetch_add(1, memory_order_release);
+                }, static_cast<int>(i));
+            }
+            while (finished.load(memory_order_acquire) < cells.size()) {
+                this_thread::sleep_for(chrono::milliseconds(10));
+            }
+        }
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+        out << "dealer_rule,seats,decks,penetration,policy,hands,edge,ci95,seconds" << endl;
+        for (const auto& cell : cells) {
+            out << ruleName(cell.rule) << ',' << cell.seats << ',' << cell.decks << ','
+                << cell.penetration << ',' << cell.policy << ',' << cell.edge.count << ','
+                << cell.edge.mean << ',' << cell.edge.halfWidth() << ',' << cell.seconds << endl;
+        }
+        cout << "Finished in " << fixed << setprecision(2) << seconds << "s" << endl;
+    }
+};
+
+// Read only memory map of a whole file, pages are read from disk as they are touched
+// so a replay streams through a huge recording without copying it into the heap
+class MappedFile {
+private:
+    const uint8_t* bytes;
+    size_t length;
+
+public:
+    MappedFile() : bytes(nullptr), length(0) {}
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile() {
+        if (bytes) munmap(const_cast<uint8_t*>(bytes), length);
+    }
+
+    bool open(const string& path) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        struct stat info;
+        if (fstat(fd, &info) != 0 || info.st_size == 0) {
+            close(fd);
+            return false;
+        }
+        void* mapped = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd); // The mapping keeps the file open
+        if (mapped == MAP_FAILED) return false;
+        madvise(mapped, info.st_size, MADV_SEQUENTIAL);
+        bytes = static_cast<const uint8_t*>(mapped);
+        length = info.st_size;
+        return true;
+    }
+
+    const uint8_t* data() const { return bytes; }
+    size_t size() const { return length; }
+};
+
+// First bytes of a shoe file, the shoes follow as decks * 52 packed cards each
+struct ShoeFileHeader {
+    char magic[8]; // "BJSHOES1"
+    uint32_t decks;
+    uint32_t seats; // Table the shoes were recorded at
+    double penetration;
+    uint64_t rounds; // Rounds played while recording
+};
+static_assert(sizeof(ShoeFileHeader) == 32, "shoe files are read by copying the header");
+
+// ShoeReplay records the shoes a simulated table deals and plays them back later
+// A recording is the header and then every shoe in deck order, one byte per card.
+// Replaying maps the file and hands the shoes straight to the Deck, which takes
+// each one in place of a shuffle, so a strategy change can be tested on the exact
+// cards of a recorded run. The same strategy reproduces the recorded results.
+class ShoeReplay {
+private:
+    long long hands = 0, playerWins = 0, dealerWins = 0, ties = 0;
+
+    void add(const RoundResult& result) {
+        hands += result.hands;
+        playerWins += result.playerWins;
+        dealerWins += result.dealerWins;
+        ties += result.ties;
+    }
+
+    void report(long long rounds, double seconds, size_t allocations) const {
+        cout << rounds << " rounds, " << hands << " hands: players won " << playerWins
+             << ", dealer won " << dealerWins << ", ties " << ties << endl;
+        cout << "Player return per hand: " << fixed << setprecision(4)
+             << static_cast<double>(playerWins - dealerWins) / max(hands, 1LL) << endl;
+        cout << setprecision(2) << seconds << "s (" << setprecision(0) << hands / max(seconds, 1e-9)
+             << " hands/sec, " << allocations << " allocations)" << endl;
+    }
+
+public:
+    // Play rounds at a table of seats and write every shoe dealt to path
+    bool record(const string& path, long long rounds, int seats, int decks, double penetration,
+                uint32_t seed, const DecisionTree& strategy) {
+        ofstream out(path, ios::binary);
+        if (!out) return false;
+        ShoeFileHeader header = {};
+        memcpy(header.magic, "BJSHOES1", 8);
+        header.decks = decks;
+        header.seats = seats;
+        header.penetration = penetration;
+        header.rounds = rounds;
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+        Blackjack game(seats);
+        game.setRecordGraph(false);
+        game.setStrategy(strategy);
+        game.setShoe(decks, penetration);
+        game.seed(seed);
+        game.recordShoes(&out);
+        size_t allocsBefore = allocationCount;
+        auto start = chrono::steady_clock::now();
+        for (long long r = 0; r < rounds; r++) {
+            add(game.simulateRound());
+        }
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        report(rounds, seconds, allocationCount - allocsBefore);
+        game.recordShoes(nullptr);
+        return static_cast<bool>(out.flush());
+    }
+
+    // Play the recorded rounds of path again with strategy for the computer seats
+    // Stops after the recorded number of rounds or when the shoes run out, which
+    // can come first when the strategy draws more cards than the recorded one.
+    // With interactive set the human plays the recorded shoes through play().
+    bool replay(const string& path, const DecisionTree& strategy, bool interactive) {
+        MappedFile file;
+        ShoeFileHeader header;
+        if (!file.open(path) || file.size() < sizeof(header)) {
+            cout << "Could not read " << path << endl;
+            return false;
+        }
+        memcpy(&header, file.data(), sizeof(header));
+        if (memcmp(header.magic, "BJSHOES1", 8) != 0 || header.decks == 0 || header.decks > 64
+            || header.seats == 0 || header.seats > 16) {
+            cout << path << " is not a shoe recording." << endl;
+            return false;
+        }
+        size_t shoeSize = header.decks * 52;
+        size_t shoes = (file.size() - sizeof(header)) / shoeSize;
+        if (shoes == 0) {
+            cout << path << " holds no complete shoe." << endl;
+            return false;
+        }
+        // Reject bad files here, a byte that is not a real card would break dealing
+        if (!(header.penetration > 0 && header.penetration <= 1)) {
+            cout << path << " has a penetration outside (0, 1]." << endl;
+            return false;
+        }
+        const uint8_t* cards = file.data() + sizeof(header);
+        for (size_t i = 0; i < shoes * shoeSize; i++) {
+            if (!Cards::isValidPacked(cards[i])) {
+                cout << path << " has an invalid card at byte " << sizeof(header) + i << "." << endl;
+                return false;
+            }
+        }
+        cout << "Replaying " << shoes << " shoes of " << header.decks << " deck(s) at a table of "
+             << header.seats << endl;
+
+        Blackjack game(header.seats);
+        game.setRecordGraph(false);
+        game.setStrategy(strategy);
+        game.setShoe(header.decks, header.penetration);
+        game.replayShoes(cards, shoes);
+        if (interactive) {
+            game.play();
+            return true;
+        }
+
+        size_t allocsBefore = allocationCount;
+        auto start = chrono::steady_clock::now();
+        long long rounds = 0;
+        while (rounds < static_cast<long long>(header.rounds)) {
+            RoundResult result = game.simulateRound();
+            if (game.replayFinished()) break; // This round wrapped back to the first shoe
+            add(result);
+            rounds++;
+        }
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        report(rounds, seconds, allocationCount - allocsBefore);
+        return true;
+    }
+};
+
+// One player connected to the server, the game is created once a table is picked
+// The members are destroyed bottom up, so the coroutine goes before its game
+struct ServerSession {
+    int fd;
+    bool writing = false; // Waiting for the socket to take more of outgoing
+    bool closed = false;
+    unique_ptr<Blackjack> game;
+    KeySource input;
+    GameTask task;
+    string outgoing; // Screen text the socket has not taken yet
+};
+
+// BlackjackServer hosts play() games for many players over loopback TCP
+// Every thread has its own listening socket on the same port (SO_REUSEPORT) and
+// its own epoll set, so a session stays on the thread that accepted it and no
+// session state is shared. Each game is a Blackjack::session() coroutine: when a
+// key arrives the thread resumes it, the computer seats and the dealer play out
+// at once, and when it waits for the next key the thread sends the screen and
+// goes on to other sockets. No session has a thread of its own.
+// stop() or SIGINT/SIGTERM during run() signal an eventfd that is in every epoll
+// set, each thread then closes its sessions and run() returns once all are done.
+class BlackjackServer {
+private:
+    int port;
+    DecisionTree strategy;
+    atomic<long long> sessions{0}; // Connected right now
+    int stopEvent; // eventfd, readable once the server should stop
+
+    static constexpr const char* welcome =
+        "Welcome to the Blackjack Casino!\n"
+        "There are 4 available tables:\n"
+        "Table 1 (3 players), Table 2 (1 player), Table 3 (5 players), Table 4 (2 players)\n"
+        "Enter a game for:\n";
+
+    // Send as much of outgoing as the socket takes, and ask epoll to say when
+    // it can take the rest
+    void flush(int epoll, ServerSession* session) {
+        while (!session->outgoing.empty()) {
+            ssize_t sent = send(session->fd, session->outgoing.data(), session->outgoing.size(), MSG_NOSIGNAL);
+            if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+            if (sent <= 0) {
+                session->closed = true;
+                return;
+            }
+            session->outgoing.erase(0, sent);
+        }
+        bool wantWrite = !session->outgoing.empty();
+        if (wantWrite != session->writing) {
+            epoll_event event = {};
+            event.events = static_cast<uint32_t>(EPOLLIN | EPOLLRDHUP) | (wantWrite ? static_cast<uint32_t>(EPOLLOUT) : 0u);
+            event.data.ptr = session;
+            epoll_ctl(epoll, EPOLL_CTL_MOD, session->fd, &event);
+            session->writing = wantWrite;
+        }
+    }
+
+    // A key from the player: the table choice first, then Player 1's keys
+    void key(ServerSession* session, char value) {
+        if (isspace(static_cast<unsigned char>(value)) || (session->game && session->task.done())) return;
+        if (!session->game) {
+            int tableSeats[4] = {3, 1, 5, 2};
+            int table = value - '0';
+            if (table < 1 || table > 4) {
+                session->input.screen << "Invalid choice. Defaulting to Table 2 (1 player).\n";
+                table = 2;
+            }
+            session->game = make_unique<Blackjack>(tableSeats[table - 1]);
+            session->game->setStrategy(strategy);
+            session->task = session->game->session(session->input);
+        } else {
+            session->input.deliver(value);
+        }
+        session->outgoing += session->input.screen.view();
+        session->input.screen.clear();
+    }
+
+    void close(int epoll, ServerSession* session, unordered_set<ServerSession*>& open) {
+        epoll_ctl(epoll, EPOLL_CTL_DEL, session->fd, nullptr);
+        ::close(session->fd);
+        open.erase(session);
+        delete session;
+        sessions--;
+    }
+
+    void serveThread(int listener) {
+        int epoll = epoll_create1(0);
+        epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.ptr = nullptr; // The listening socket
+        epoll_ctl(epoll, EPOLL_CTL_ADD, listener, &event);
+        event.data.ptr = &stopEvent;
+        epoll_ctl(epoll, EPOLL_CTL_ADD, stopEvent, &event);
+        unordered_set<ServerSession*> open; // Sessions this thread accepted
+        epoll_event events[256];
+        bool stopping = false;
+        while (!stopping) {
+            int count = epoll_wait(epoll, events, 256, -1);
+            if (count < 0 && errno != EINTR) break;
+            for (int i = 0; i < count; i++) {
+                if (events[i].data.ptr == &stopEvent) {
+                    stopping = true; // Left unread so every thread sees it
+                    continue;
+                }
+                ServerSession* session = static_cast<ServerSession*>(events[i].data.ptr);
+                if (!session) {
+                    int fd;
+                    while ((fd = accept4(listener, nullptr, nullptr, SOCK_NONBLOCK)) >= 0) {
+                        session = new ServerSession();
+                        session->fd = fd;
+                        session->outgoing = welcome;
+                        epoll_event added = {};
+                        added.events = EPOLLIN | EPOLLRDHUP;
+                        added.data.ptr = session;
+                        epoll_ctl(epoll, EPOLL_CTL_ADD, fd, &added);
+                        open.insert(session);
+                        sessions++;
+                        flush(epoll, session);
+                        if (session->closed) close(epoll, session, open);
+                    }
+                    continue;
+                }
+                if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+                    char buffer[512];
+                    ssize_t got;
+                    while ((got = recv(session->fd, buffer, sizeof(buffer), 0)) > 0) {
+                        for (ssize_t k = 0; k < got; k++) {
+                            key(session, buffer[k]);
+                        }
+                    }
+                    if (got == 0 || (got < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+                        session->closed = true;
+                    }
+                }
+                if (!session->closed) flush(epoll, session);
+                bool finished = session->game && session->task.done() && session->outgoing.empty();
+                if (session->closed || finished) close(epoll, session, open);
+            }
+        }
+        while (!open.empty()) {
+            close(epoll, *open.begin(), open);
+        }
+        ::close(epoll);
+    }
+
+public:
+    BlackjackServer(int listenPort, const DecisionTree& tree)
+        : port(listenPort), strategy(tree), stopEvent(eventfd(0, EFD_NONBLOCK)) {}
+
+    ~BlackjackServer() {
+        if (stopEvent >= 0) ::close(stopEvent);
+    }
+
+    BlackjackServer(const BlackjackServer&) = delete;
+    BlackjackServer& operator=(const BlackjackServer&) = delete;
+
+    // Make run() close every session and return, safe from any thread
+    void stop() {
+        uint64_t one = 1;
+        ssize_t written = write(stopEvent, &one, sizeof(one));
+        (void)written;
+    }
+
+    // Serve on threads threads until stop(), SIGINT or SIGTERM, false if the port can't be opened
+    bool run(int threads) {
+        if (stopEvent < 0) return false;
+        vector<int> listeners;
+        for (int t = 0; t < threads; t++) {
+            int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+            int on = 1;
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+            setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on));
+            sockaddr_in address = {};
+            address.sin_family = AF_INET;
+            address.sin_port = htons(static_cast<uint16_t>(port));
+            address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            if (fd < 0 || bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(fd, 1024) != 0) {
+                for (int open : listeners) ::close(open);
+                if (fd >= 0) ::close(fd);
+                return false;
+            }
+            listeners.push_back(fd);
+        }
+        cout << "Serving Blackjack on 127.0.0.1:" << port << " with " << threads << " threads" << endl;
+        // Block the stop signals before starting threads, so they inherit the mask
+        // and the signals only arrive through signalfd
+        sigset_t stopSignals, previous;
+        sigemptyset(&stopSignals);
+        sigaddset(&stopSignals, SIGINT);
+        sigaddset(&stopSignals, SIGTERM);
+        pthread_sigmask(SIG_BLOCK, &stopSignals, &previous);
+        int signals = signalfd(-1, &stopSignals, SFD_NONBLOCK);
+        vector<thread> pool;
+        for (int fd : listeners) {
+            pool.emplace_back(&BlackjackServer::serveThread, this, fd);
+        }
+        // Report the number of players now and then until told to stop
+        long long last = -1;
+        pollfd waits[2] = {{stopEvent, POLLIN, 0}, {signals, POLLIN, 0}};
+        while (true) {
+            int ready = poll(waits, signals >= 0 ? 2 : 1, 10000);
+            if (ready > 0 || (ready < 0 && errno != EINTR)) {
+                signalfd_siginfo taken;
+                while (signals >= 0 && read(signals, &taken, sizeof(taken)) > 0) {
+                    // Take the signal so it isn't delivered when the mask is put back
+                }
+                stop(); // Already set when stopEvent woke us, harmless again
+                break;
+            }
+            long long now = sessions.load();
+            if (now != last) cout << now << " players connected" << endl;
+            last = now;
+        }
+        for (auto& worker : pool) {
+            worker.join();
+        }
+        for (int fd : listeners) {
+            ::close(fd);
+        }
+        if (signals >= 0) ::close(signals);
+        pthread_sigmask(SIG_SETMASK, &previous, nullptr);
+        cout << "Server stopped" << endl;
+        return true;
+    }
+};
+
+// Time every round of one table with shuffles done inline and then with a
+// ShufflePool, and print the latency percentiles of both
+void runLatency(long long rounds, int seats, int decks, uint32_t seed) {
+    vector<uint32_t> samples(rounds);
+    cout << left << setw(16) << "shuffle" << right << setw(10) << "p50 ns" << setw(10) << "p90 ns"
+         << setw(10) << "p99 ns" << setw(11) << "p99.9 ns" << setw(12) << "max ns" << setw(10) << "misses" << endl;
+    for (int pooled = 0; pooled < 2; pooled++) {
+        ShufflePool pool(decks, seed + 1);
+        Blackjack game(seats);
+        game.setRecordGraph(false);
+        game.setShoe(decks, 0.75);
+        game.seed(seed);
+        if (pooled) game.useShufflePool(&pool);
+        for (int i = 0; i < 1000; i++) {
+            game.simulateRound();
+        }
+        for (long long r = 0; r < rounds; r++) {
+            auto start = chrono::steady_clock::now();
+            game.simulateRound();
+            auto end = chrono::steady_clock::now();
+            samples[r] = static_cast<uint32_t>(min<long long>(chrono::duration_cast<chrono::nanoseconds>(end - start).count(), UINT32_MAX));
+        }
+        sort(samples.begin(), samples.end());
+        auto at = [&samples](double fraction) { return samples[static_cast<size_t>(fraction * (samples.size() - 1))]; };
+        cout << left << setw(16) << (pooled ? "pool" : "inline") << right << setw(10) << at(0.5)
+             << setw(10) << at(0.9) << setw(10) << at(0.99) << setw(11) << at(0.999)
+             << setw(12) << samples.back() << setw(10) << (pooled ? pool.missed() : 0) << endl;
+    }
+}
+
+// One benchmark result, items are hands for the round benchmark and calls otherwise
+struct BenchResult {
+    string name;
+    long long iterations;
+    double nsPerOp;
+    double allocsPerOp;
+    double itemsPerSec;
+};
+
+// Time iterations calls of body and count the heap allocations they made
+template <typename Body>
+BenchResult runBench(const string& name, long long iterations, int itemsPerOp, Body body) {
+    size_t allocsBefore = allocationCount;
+    auto start = chrono::steady_clock::now();
+    for (long long i = 0; i < iterations; i++) {
+        body(i);
+    }
+    auto end = chrono::steady_clock::now();
+    double ns = chrono::duration<double, nano>(end - start).count();
+    BenchResult result;
+    result.name = name;
+    result.iterations = iterations;
+    result.nsPerOp = ns / iterations;
+    result.allocsPerOp = static_cast<double>(allocationCount - allocsBefore) / iterations;
+    result.itemsPerSec = iterations * itemsPerOp / (ns / 1e9);
+    return result;
+}
+
+// Run the hot path benchmarks, print a table and optionally write a CSV file
+void runBenchmarks(const char* csvPath) {
+    vector<BenchResult> results;
+    long long sink = 0; // Consumed at the end so the loops are not optimized away
+
+    Deck deck;
+    results.push_back(runBench("deck_deal", 2000000, 1, [&](long long) {
+        sink += deck.deal().getRawValue();
+    }));
+    results.push_back(runBench("deck_shuffle", 20000, 1, [&](long long) {
+        deck.shuffle();
+    }));
+
+    // A spread of hands from 2 to 6 cards with and without aces
+    vector<Hand> hands(64);
+    for (size_t i = 0; i < hands.size(); i++) {
+        int count = 2 + static_cast<int>(i % 5);
+        for (int c = 0; c < count; c++) {
+            hands[i].addCard(deck.deal());
+        }
+    }
+    results.push_back(runBench("hand_getValue", 2000000, 1, [&](long long i) {
+        sink += hands[i & 63].getValue();
+    }));
+
+    // The same kind of hands evaluated 4096 at a time
+    HandBatch batch(4096);
+    for (size_t i = 0; i < batch.size(); i++) {
+        int count = 2 + static_cast<int>(i % 5);
+        for (int c = 0; c < count; c++) {
+            batch.addCard(i, deck.deal());
+        }
+    }
+    results.push_back(runBench("batch_evaluate_4096", 20000, static_cast<int>(batch.size()), [&](long long i) {
+        batch.evaluate();
+        sink += batch.getValue(i & 4095);
+    }));
+
+    DecisionTree ai;
+    results.push_back(runBench("tree_shouldHit", 5000000, 1, [&](long long i) {
+        sink += ai.shouldHit(4 + static_cast<int>(i % 18), 2 + static_cast<int>(i % 10));
+    }));
+
+    // A balanced 64k node tree shows how per-decision time grows with tree size
+    DecisionTree bigTree;
+    bigTree.clear();
+    bigTree.reserve(1 << 16);
+    mt19937 treeRng(12345);
+    vector<uint32_t> level;
+    for (int i = 0; i < (1 << 15); i++) {
+        level.push_back(bigTree.addLeaf(treeRng() & 1));
+    }
+    while (level.size() > 1) {
+        vector<uint32_t> next;
+        for (size_t i = 0; i < level.size(); i += 2) {
+            DecisionTree::Feature feature = static_cast<DecisionTree::Feature>(treeRng() % 3);
+            int threshold = feature == DecisionTree::HandValue ? 4 + treeRng() % 17
+                          : feature == DecisionTree::DealerUpCard ? 1 + treeRng() % 10 : 0;
+            next.push_back(bigTree.addSplit(feature, threshold, level[i], level[i + 1]));
+        }
+        level.swap(next);
+    }
+    bigTree.setRoot(level[0]);
+    results.push_back(runBench("tree_shouldHit_64k", 5000000, 1, [&](long long i) {
+        sink += bigTree.shouldHit(4 + static_cast<int>(i % 18), 1 + static_cast<int>(i % 10), i & 1);
+    }));
+
+    // Full rounds at each table size offered by main()
+    int tableSizes[4] = {1, 2, 3, 5};
+    for (int seats : tableSizes) {
+        Blackjack game(seats);
+        results.push_back(runBench("round_" + to_string(seats) + "_seats", 20000, seats,
+            [&](long long) { game.simulateRound(); }));
+    }
+
+    // Formatting a finished 5 seat round into the screen buffer
+    Blackjack renderGame(5);
+    renderGame.setRecordGraph(false);
+    renderGame.simulateRound();
+    ScreenBuffer screen;
+    results.push_back(runBench("render_table_5", 2000000, 1, [&](long long) {
+        screen.clear();
+        renderGame.renderTable(screen, false);
+        sink += static_cast<long long>(screen.size());
+    }));
+
+    // The same rounds through the compile time engine
+    Blackjack2Engine<1> engine1;
+    Blackjack2Engine<2> engine2;
+    Blackjack2Engine<3> engine3;
+    Blackjack2Engine<5> engine5;
+    Blackjack1Engine engineBlackjack1;
+    results.push_back(runBench("engine_1_seats", 20000, 1, [&](long long) { engine1.playRound(); }));
+    results.push_back(runBench("engine_2_seats", 20000, 2, [&](long long) { engine2.playRound(); }));
+    results.push_back(runBench("engine_3_seats", 20000, 3, [&](long long) { engine3.playRound(); }));
+    results.push_back(runBench("engine_5_seats", 20000, 5, [&](long long) { engine5.playRound(); }));
+    results.push_back(runBench("engine_blackjack1", 20000, 1, [&](long long) { engineBlackjack1.playRound(); }));
+
+    cout << left << setw(18) << "benchmark" << right << setw(12) << "ns/op"
+         << setw(12) << "allocs/op" << setw(16) << "items/sec" << endl;
+    for (const auto& r : results) {
+        cout << left << setw(18) << r.name << right << fixed << setprecision(1)
+             << setw(12) << r.nsPerOp << setw(12) << r.allocsPerOp
+             << setw(16) << r.itemsPerSec << endl;
+    }
+    cout << "(round items are hands, checksum " << sink << ")" << endl;
+
+    if (csvPath) {
+        ofstream out(csvPath);
+        out << "name,iterations,ns_per_op,allocs_per_op,items_per_sec" << endl;
+        for (const auto& r : results) {
+            out << "blackjack2/" << r.name << ',' << r.iterations << ',' << r.nsPerOp << ','
+                << r.allocsPerOp << ',' << r.itemsPerSec << endl;
+        }
+    }
+}
+
+// Count the heap allocations of rounds played after a warm up, which must be zero
+// The warm up lets the deck, the stats map and every vector reach their final size
+template <typename Round>
+bool checkAllocations(const string& name, long long rounds, Round round) {
+    for (int i = 0; i < 1000; i++) {
+        round();
+    }
+    size_t allocsBefore = allocationCount;
+    for (long long i = 0; i < rounds; i++) {
+        round();
+    }
+    size_t allocs = allocationCount - allocsBefore;
+    cout << left << setw(18) << name << right << setw(12) << allocs
+         << (allocs == 0 ? "  PASS" : "  FAIL") << endl;
+    return allocs == 0;
+}
+
+// Check that simulated rounds never touch the heap, every table size and engine
+// Game graph recording stores every round so it is turned off, as in all the
+// simulation modes. Returns false if any round allocated.
+bool runAllocationCheck(long long rounds) {
+    bool passed = true;
+    cout << left << setw(18) << "rounds" << right << setw(12) << "allocs" << endl;
+
+    int tableSizes[4] = {1, 2, 3, 5};
+    for (int seats : tableSizes) {
+        Blackjack game(seats);
+        game.setRecordGraph(false);
+        passed = checkAllocations("round_" + to_string(seats) + "_seats", rounds,
+            [&]() { game.simulateRound(); }) && passed;
+    }
+
+    // Rendering a round reuses the screen buffer's memory
+    Blackjack renderGame(5);
+    renderGame.setRecordGraph(false);
+    ScreenBuffer screen;
+    passed = checkAllocations("render_table_5", rounds, [&]() {
+        renderGame.simulateRound();
+        screen.clear();
+        renderGame.renderTable(screen, false);
+    }) && passed;
+
+    Blackjack2Engine<1> engine1;
+    Blackjack2Engine<2> engine2;
+    Blackjack2Engine<3> engine3;
+    Blackjack2Engine<5> engine5;
+    Blackjack1Engine engineBlackjack1;
+    passed = checkAllocations("engine_1_seats", rounds, [&]() { engine1.playRound(); }) && passed;
+    passed = checkAllocations("engine_2_seats", rounds, [&]() { engine2.playRound(); }) && passed;
+    passed = checkAllocations("engine_3_seats", rounds, [&]() { engine3.playRound(); }) && passed;
+    passed = checkAllocations("engine_5_seats", rounds, [&]() { engine5.playRound(); }) && passed;
+    passed = checkAllocations("engine_blackjack1", rounds, [&]() { engineBlackjack1.playRound(); }) && passed;
+
+    cout << (passed ? "No heap allocations per round" : "Rounds allocated on the heap") << endl;
+    return passed;
+}
+
+int main(int argc, char** argv) {
+    // Benchmark mode: main --bench [results.csv]
+    if (argc > 1 && strcmp(argv[1], "--bench") == 0) {
+        runBenchmarks(argc > 2 ? argv[2] : nullptr);
+        return 0;
+    }
+
+    // Allocation check mode: main --alloc-check [rounds], exit status 1 on failure
+    if (argc > 1 && strcmp(argv[1], "--alloc-check") == 0) {
+        long long rounds = argc > 2 ? max(atoll(argv[2]), 1LL) : 100000;
+        return runAllocationCheck(rounds) ? 0 : 1;
+    }
+
+    // Latency mode: main --latency rounds [table] [decks] [--seed n]
+    if (argc > 2 && strcmp(argv[1], "--latency") == 0) {
+        long long rounds = max(atoll(argv[2]), 1LL);
+        int tableSeats[4] = {3, 1, 5, 2};
+        int table = 2;
+        int decks = 6;
+        uint32_t seed = random_device{}();
+        int positional = 0;
+        for (int i = 3; i < argc; i++) {
+            if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+                seed = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+            } else if (positional++ == 0) {
+                table = min(max(atoi(argv[i]), 1), 4);
+            } else {
+                decks = min(max(atoi(argv[i]), 1), 8);
+            }
+        }
+        runLatency(rounds, tableSeats[table - 1], decks, seed);
+        return 0;
+    }
+
+    // Training mode: main --train rounds [strategy.tree]
+    if (argc > 2 && strcmp(argv[1], "--train") == 0) {
+        long long rounds = atoll(argv[2]);
+        const char* path = argc > 3 ? argv[3] : "strategy.tree";
+        int threads = max(1u, thread::hardware_concurrency());
+        StrategyTrainer trainer;
+        trainer.train(max(rounds, 1LL), 4, threads);
+        trainer.printChart();
+        ofstream out(path);
+        trainer.getTree().save(out);
+        cout << "Wrote " << path << endl;
+        return 0;
+    }
+
+    // A trained tree for the computer players: main --strategy strategy.tree
+    DecisionTree strategy;
+    if (argc > 2 && strcmp(argv[1], "--strategy") == 0) {
+        ifstream in(argv[2]);
+        DecisionTree loaded;
+        if (in && loaded.load(in)) {
+            strategy = loaded;
+            cout << "Loaded strategy from " << argv[2] << " (" << strategy.size() << " nodes)" << endl;
+        } else {
+            cout << "Could not read " << argv[2] << ", using the default strategy." << endl;
+        }
+    }
+
+    // Compare the default tree (A) with a trained one or "hit below 17" (B) on the same shoes:
+    // main --compare rounds [strategy.tree] [--antithetic] [--seed n]
+    if (argc > 2 && strcmp(argv[1], "--compare") == 0) {
+        long long rounds = max(atoll(argv[2]), 1LL);
+        bool antithetic = false;
+        uint32_t seed = random_device{}();
+        DecisionTree policyB;
+        policyB.clear();
+        policyB.setRoot(policyB.addSplit(DecisionTree::HandValue, 16, policyB.addLeaf(true), policyB.addLeaf(false)));
+        for (int i = 3; i < argc; i++) {
+            if (strcmp(argv[i], "--antithetic") == 0) {
+                antithetic = true;
+            } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+                seed = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+            } else {
+                ifstream in(argv[i]);
+                if (!in || !policyB.load(in)) {
+                    cout << "Could not read " << argv[i] << endl;
+                    return 1;
+                }
+            }
+        }
+        StrategyComparison comparison;
+        comparison.run(strategy, policyB, rounds, seed, antithetic);
+        return 0;
+    }
+
+    // Markov mode: main --markov rounds [table] [threads] [--seed n]
+    if (argc > 2 && strcmp(argv[1], "--markov") == 0) {
+        long long rounds = max(atoll(argv[2]), 2LL);
+        int tableSeats[4] = {3, 1, 5, 2};
+        int table = 2;
+        int threads = static_cast<int>(max(1u, thread::hardware_concurrency()));
+        uint32_t seed = random_device{}();
+        int positional = 0;
+        for (int i = 3; i < argc; i++) {
+            if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+                seed = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+            } else if (positional++ == 0) {
+                table = min(max(atoi(argv[i]), 1), 4);
+            } else {
+                threads = max(atoi(argv[i]), 1);
+            }
+        }
+        MarkovSimulation simulation(tableSeats[table - 1]);
+        simulation.run(rounds, threads, seed);
+        return 0;
+    }
+
+    // Run one table until every seat's return is known to +/- width (95% CI):
+    // main --adaptive width [table] [threads] [--seed n] [--max hands]
+    if (argc > 2 && strcmp(argv[1], "--adaptive") == 0) {
+        double width = atof(argv[2]);
+        int tableSeats[4] = {3, 1, 5, 2};
+        int table = 2;
+        int threads = static_cast<int>(max(1u, thread::hardware_concurrency()));
+        uint32_t seed = random_device{}();
+        long long maxHands = 1000000000LL;
+        int positional = 0;
+        for (int i = 3; i < argc; i++) {
+            if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+                seed = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+            } else if (strcmp(argv[i], "--max") == 0 && i + 1 < argc) {
+                maxHands = max(atoll(argv[++i]), 1LL);
+            } else if (positional++ == 0) {
+                table = min(max(atoi(argv[i]), 1), 4);
+            } else {
+                threads = max(atoi(argv[i]), 1);
+            }
+        }
+        if (width <= 0) {
+            cout << "The target width must be greater than 0." << endl;
+            return 1;
+        }
+        AdaptiveSimulation simulation(tableSeats[table - 1]);
+        simulation.run(width, maxHands, threads, seed);
+        return 0;
+    }
+
+    // Exact expected return of one round from a fresh or depleted shoe:
+    // main --exact [strategy.tree] [--dealer bj1|bj2|h17] [--decks n] [--remove 1,10,5]
+    if (argc > 1 && strcmp(argv[1], "--exact") == 0) {
+        DecisionTree policy;
+        DealerRule rule = HitBelow17UnlessAhead;
+        int decks = 1;
+        vector<int> removed;
+        for (int i = 2; i < argc; i++) {
+            bool hasValue = i + 1 < argc;
+            if (strcmp(argv[i], "--dealer") == 0 && hasValue) {
+                string name = argv[++i];
+                if (!ScenarioSweep::parseRule(name, rule)) {
+                    cout << "Unknown dealer rule " << name << ", use bj1, bj2 or h17." << endl;
+                    return 1;
+                }
+            } else if (strcmp(argv[i], "--decks") == 0 && hasValue) {
+                decks = max(atoi(argv[++i]), 1);
+            } else if (strcmp(argv[i], "--remove") == 0 && hasValue) {
+                stringstream in(argv[++i]);
+                string item;
+                while (getline(in, item, ',')) {
+                    int value = 0;
+                    auto parsed = from_chars(item.data(), item.data() + item.size(), value);
+                    if (parsed.ec != errc() || parsed.ptr != item.data() + item.size() || value < 1 || value > 10) {
+                        cout << "Cannot remove " << item << ", use card values 1 (Ace) to 10." << endl;
+                        return 1;
+                    }
+                    removed.push_back(value);
+                }
+            } else {
+                ifstream in(argv[i]);
+                if (!in || !policy.load(in)) {
+                    cout << "Could not read " << argv[i] << endl;
+                    return 1;
+                }
+            }
+        }
+        Deck shoe;
+        shoe.setShoe(decks, 1.0);
+        int counts[11];
+        shoe.remainingCounts(counts);
+        for (int v : removed) {
+            if (counts[v] == 0) {
+                cout << "The shoe holds no more cards of value " << v << " to remove." << endl;
+                return 1;
+            }
+            counts[v]--;
+        }
+        double expected;
+        size_t states;
+        auto start = chrono::steady_clock::now();
+        ExactRound exact(policy, rule);
+        if (!exact.run(counts, static_cast<int>(max(1u, thread::hardware_concurrency())), expected, states)) {
+            cout << "Too many cards of one value for the exact search." << endl;
+            return 1;
+        }
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        cout << "Exact expected return per round: " << fixed << setprecision(6) << expected << endl;
+        cout << states << " hand states in " << setprecision(2) << seconds << "s" << endl;
+        return 0;
+    }
+
+    // Sweep rule and table variants, lists are comma separated:
+    // main --sweep rounds [threads] [--dealer bj1,bj2,h17] [--seats 1,2,3,5] [--decks 1,6]
+    //      [--pen 0.75,1] [--policy tree,hit17,trained] [--seed n] [--out results.csv]
+    if (argc > 2 && strcmp(argv[1], "--sweep") == 0) {
+        long long rounds = max(atoll(argv[2]), 1LL);
+        int threads = static_cast<int>(max(1u, thread::hardware_concurrency()));
+        uint32_t seed = random_device{}();
+        string outPath;
+        ScenarioSweep sweep;
+        auto split = [](const char* text) {
+            vector<string> items;
+            stringstream in(text);
+            string item;
+            while (getline(in, item, ',')) {
+                if (!item.empty()) items.push_back(item);
+            }
+            return items;
+        };
+        for (int i = 3; i < argc; i++) {
+            bool hasValue = i + 1 < argc;
+            if (strcmp(argv[i], "--dealer") == 0 && hasValue) {
+                sweep.rules.clear();
+                for (const auto& name : split(argv[++i])) {
+                    DealerRule rule;
+                    if (!ScenarioSweep::parseRule(name, rule)) {
+                        cout << "Unknown dealer rule " << name << ", use bj1, bj2 or h17." << endl;
+                        return 1;
+                    }
+                    sweep.rules.push_back(rule);
+                }
+            } else if (strcmp(argv[i], "--seats") == 0 && hasValue) {
+                sweep.seats.clear();
+                for (const auto& n : split(argv[++i])) sweep.seats.push_back(max(atoi(n.c_str()), 1));
+            } else if (strcmp(argv[i], "--decks") == 0 && hasValue) {
+                sweep.decks.clear();
+                for (const auto& n : split(argv[++i])) sweep.decks.push_back(max(atoi(n.c_str()), 1));
+            } else if (strcmp(argv[i], "--pen") == 0 && hasValue) {
+                sweep.penetrations.clear();
+                for (const auto& n : split(argv[++i])) sweep.penetrations.push_back(atof(n.c_str()));
+            } else if (strcmp(argv[i], "--policy") == 0 && hasValue) {
+                sweep.policies = split(argv[++i]);
+                for (const auto& name : sweep.policies) {
+                    if (!ScenarioSweep::isPolicy(name)) {
+                        cout << "Unknown policy " << name << ", use tree, hit17 or trained." << endl;
+                        return 1;
+                    }
+                }
+            } else if (strcmp(argv[i], "--seed") == 0 && hasValue) {
+                seed = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+            } else if (strcmp(argv[i], "--out") == 0 && hasValue) {
+                outPath = argv[++i];
+            } else {
+                // Anything else must be the thread count
+                const char* end = argv[i] + strlen(argv[i]);
+                int count = 0;
+                auto parsed = from_chars(argv[i], end, count);
+                if (parsed.ec != errc() || parsed.ptr != end || count < 1) {
+                    cout << "Unknown sweep option " << argv[i] << "." << endl;
+                    return 1;
+                }
+                threads = count;
+            }
+        }
+        if (outPath.empty()) {
+            sweep.run(rounds, threads, seed, cout);
+        } else {
+            ofstream out(outPath);
+            sweep.run(rounds, threads, seed, out);
+            cout << "Wrote " << outPath << endl;
+        }
+        return 0;
+    }
+
+    // Record the shoes of a simulated table: main --record rounds file [table] [strategy.tree]
+    //      [--seed n] [--decks n] [--pen p]
+    // and play them again: main --replay file [strategy.tree] [--play]
+    if (argc > 3 && strcmp(argv[1], "--record") == 0) {
+        long long rounds = max(atoll(argv[2]), 1LL);
+        int tableSeats[4] = {3, 1, 5, 2};
+        int table = 2;
+        int decks = 1;
+        double penetration = 1.0;
+        uint32_t seed = random_device{}();
+        DecisionTree policy;
+        for (int i = 4; i < argc; i++) {
+            bool hasValue = i + 1 < argc;
+            if (strcmp(argv[i], "--seed") == 0 && hasValue) {
+                seed = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+            } else if (strcmp(argv[i], "--decks") == 0 && hasValue) {
+                decks = min(max(atoi(argv[++i]), 1), 64);
+            } else if (strcmp(argv[i], "--pen") == 0 && hasValue) {
+                penetration = atof(argv[++i]);
+            } else if (isdigit(static_cast<unsigned char>(argv[i][0]))) {
+                table = min(max(atoi(argv[i]), 1), 4);
+            } else {
+                ifstream in(argv[i]);
+                if (!in || !policy.load(in)) {
+                    cout << "Could not read " << argv[i] << endl;
+                    return 1;
+                }
+            }
+        }
+        ShoeReplay recording;
+        if (!recording.record(argv[3], rounds, tableSeats[table - 1], decks, penetration, seed, policy)) {
+            cout << "Could not write " << argv[3] << endl;
+            return 1;
+        }
+        cout << "Wrote " << argv[3] << endl;
+        return 0;
+    }
+    if (argc > 2 && strcmp(argv[1], "--replay") == 0) {
+        DecisionTree policy;
+        bool interactive = false;
+        for (int i = 3; i < argc; i++) {
+            if (strcmp(argv[i], "--play") == 0) {
+                interactive = true;
+            } else {
+                ifstream in(argv[i]);
+                if (!in || !policy.load(in)) {
+                    cout << "Could not read " << argv[i] << endl;
+                    return 1;
+                }
+            }
+        }
+        ShoeReplay replay;
+        return replay.replay(argv[2], policy, interactive) ? 0 : 1;
+    }
+
+    // Interactive games for many players: main --server [port] [threads] [strategy.tree]
+    if (argc > 1 && strcmp(argv[1], "--server") == 0) {
+        int port = argc > 2 ? atoi(argv[2]) : 7777;
+        int threads = argc > 3 ? max(atoi(argv[3]), 1) : static_cast<int>(max(1u, thread::hardware_concurrency()));
+        DecisionTree policy;
+        if (argc > 4) {
+            ifstream in(argv[4]);
+            if (!in || !policy.load(in)) {
+                cout << "Could not read " << argv[4] << endl;
+                return 1;
+            }
+        }
+        BlackjackServer server(port, policy);
+        if (!server.run(threads)) {
+            cout << "Could not listen on port " << port << endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    // Casino mode, every table at once:
+    // main --casino rounds [copies] [threads] [--seed n] [--checkpoint file [seconds]] [--resume file]
+    if (argc > 2 && strcmp(argv[1], "--casino") == 0) {
+        long long rounds = max(atoll(argv[2]), 1LL);
+        int copies = 1;
+        int threads = static_cast<int>(max(1u, thread::hardware_concurrency()));
+        uint32_t seed = random_device{}();
+        string checkpointPath, resumePath;
+        double checkpointSeconds = 60;
+        int positional = 0;
+        for (int i = 3; i < argc; i++) {
+            if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+                seed = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+            } else if (strcmp(argv[i], "--checkpoint") == 0 && i + 1 < argc) {
+                checkpointPath = argv[++i];
+                if (i + 1 < argc && isdigit(static_cast<unsigned char>(argv[i + 1][0]))) {
+                    checkpointSeconds = atof(argv[++i]);
+                }
+            } else if (strcmp(argv[i], "--resume") == 0 && i + 1 < argc) {
+                resumePath = argv[++i];
+            } else if (positional++ == 0) {
+                copies = max(atoi(argv[i]), 1);
+            } else {
+                threads = max(atoi(argv[i]), 1);
+            }
+        }
+        Casino casino(copies, seed);
+        if (!resumePath.empty()) {
+            if (!casino.resume(resumePath)) {
+                cout << "Could not resume from " << resumePath << endl;
+                return 1;
+            }
+            cout << "Resumed from " << resumePath << endl;
+        }
+        if (!checkpointPath.empty()) {
+            casino.setCheckpoint(checkpointPath, checkpointSeconds);
+        }
+        casino.run(rounds, threads);
+        return 0;
+    }
+
     cout << "Welcome to the Blackjack Casino!" << endl;
     cout << "There are 4 available tables:" << endl;
     cout << "Table 1 (3 players), Table 2 (1 player), Table 3 (5 players), Table 4 (2 players)" << endl;
@@ -594,6 +3975,7 @@ int main(int argc, char** argv) {
     }
 
     Blackjack game(numPlayers);
+    game.setStrategy(strategy);
     game.play();
 
     return 0;
@@ -0,0 +1,400 @@
+/*
+** Card, shoe and hand core shared by Blackjack1 and Blackjack2
+**
+** Header only, build either game with the directory on the include path:
+**   g++ -std=c++20 -O3 -pthread -I../BlackjackCore main.cpp
+**
+** Cards are one packed byte, the Shoe deals packed bytes out of one buffer that
+** is sized when the number of decks is set and never allocates while dealing or
+** shuffling, and a Hand keeps its total and its display order as cards arrive.
+**
+*/
+
+#ifndef BLACKJACK_CORE_H
+#define BLACKJACK_CORE_H
+
+#include <algorithm>
+#include <array>
+#include <bitset>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <string_view>
+#include <vector>
+
+// Card names like "Queen of Hearts" preformatted at compile time, indexed by
+// Cards::pack() (value in the low 4 bits, suit index 0-3 above, 4 for no suit)
+// The text is padded to a fixed size so a ScreenBuffer copies every name with the
+// same few instructions, whatever its length
+struct CardName {
+    char text[24];
+    uint8_t length;
+    constexpr std::string_view view() const { return std::string_view(text, length); }
+};
+
+constexpr std::array<CardName, 80> makeCardNames() {
+    const char* values[4] = {"Ace", "Jack", "Queen", "King"};
+    const char* suits[5] = {"Hearts", "Diamonds", "Clubs", "Spades", "Unknown"};
+    std::array<CardName, 80> names{};
+    for (int suit = 0; suit < 5; suit++) {
+        for (int value = 0; value < 16; value++) {
+            CardName& name = names[value | (suit << 4)];
+            auto add = [&name](const char* part) {
+                while (*part) name.text[name.length++] = *part++;
+            };
+            if (value == 1 || (value >= 11 && value <= 13)) {
+                add(values[value == 1 ? 0 : value - 10]);
+            } else {
+                if (value >= 10) name.text[name.length++] = static_cast<char>('0' + value / 10);
+                name.text[name.length++] = static_cast<char>('0' + value % 10);
+            }
+            add(" of ");
+            add(suits[suit]);
+        }
+    }
+    return names;
+}
+
+inline constexpr std::array<CardName, 80> cardNames = makeCardNames();
+
+inline std::ostream& operator<<(std::ostream& out, const CardName& name) {
+    return out << name.view();
+}
+static_assert(cardNames[12 | (1 << 4)].view() == "Queen of Diamonds", "card names are indexed by Cards::pack()");
+
+// Cards class represents a single playing card
+// The card is stored packed, so a card is one byte and pack() costs nothing
+class Cards {
+private:
+    uint8_t packed; // Value 1-13 (Ace=1, Jack=11, Queen=12, King=13) in the low 4 bits, suit index above
+
+    static constexpr char suitChars[5] = {'H', 'D', 'C', 'S', ' '};
+
+    static constexpr int suitIndex(char suit) {
+        return suit == 'H' ? 0 : suit == 'D' ? 1 : suit == 'C' ? 2 : suit == 'S' ? 3 : 4;
+    }
+
+public:
+    constexpr Cards() : packed(4 << 4) {}
+    constexpr Cards(int v, char s) : packed(static_cast<uint8_t>((v & 15) | (suitIndex(s) << 4))) {}
+
+    // Display the card in a human-readable format
+    void display(std::ostream& out = std::cout) const {
+        out << name();
+    }
+
+    // Name of the card, e.g. "Ace of Spades", from the precomputed table
+    std::string_view name() const {
+        return cardNames[packed].view();
+    }
+
+    constexpr const CardName& nameEntry() const {
+        return cardNames[packed];
+    }
+
+    // Get the Blackjack value of the card
+    constexpr int getValue() const {
+        int value = packed & 15;
+        return value > 10 ? 10 : value; // Face cards worth 10
+    }
+
+    // Comparison for sorting or set operations
+    bool operator<(const Cards& other) const {
+        return (getSuit() < other.getSuit()) || (getSuit() == other.getSuit() && getRawValue() < other.getRawValue());
+    }
+
+    // Equality for hashing
+    constexpr bool operator==(const Cards& other) const {
+        return packed == other.packed;
+    }
+
+    // Getters for suit and value
+    constexpr char getSuit() const { return suitChars[packed >> 4]; }
+    constexpr int getRawValue() const { return packed & 15; }
+
+    // Packed byte for snapshots and shoes: value in the low 4 bits, suit index above
+    uint8_t pack() const {
+        return packed;
+    }
+
+    // True for a packed byte of a real card: value 1-13 and one of the four suits
+    static constexpr bool isValidPacked(uint8_t packed) {
+        return (packed & 15) >= 1 && (packed & 15) <= 13 && (packed >> 4) < 4;
+    }
+
+    static Cards unpack(uint8_t packed) {
+        Cards card;
+        card.packed = static_cast<uint8_t>((packed & 15) | (std::min(packed >> 4, 4) << 4));
+        return card;
+    }
+};
+
+// Custom hash function for Cards
+namespace std {
+    template <>
+    struct hash<Cards> {
+        size_t operator()(const Cards& card) const {
+            return hash<char>()(card.getSuit()) ^ (hash<int>()(card.getRawValue()) << 1);
+        }
+    };
+}
+
+// Shoe holds one or more decks as packed cards and deals them from the back
+// The buffer is sized by setDecks() and then only rewritten in place, so dealing,
+// shuffling, seeding and loading a recorded shoe never allocate.
+class Shoe {
+private:
+    std::vector<uint8_t> cards; // Packed cards, the next card dealt is cards[size() - 1 - top]
+    int top; // Cards dealt since the last shuffle
+    int cutCard; // Reshuffle once this many cards have been dealt
+    std::bitset<64> dealtCards; // Dealt cards, indexed by the packed card which is a perfect hash
+    std::mt19937 rng; // Seeded once so a run can be repeated and saved
+
+    // Put the cards back in new deck order: Hearts, Diamonds, Clubs, Spades, Ace to King
+    void reset() {
+        for (size_t i = 0; i < cards.size(); i++) {
+            cards[i] = static_cast<uint8_t>((i % 13 + 1) | (i / 13 % 4) << 4);
+        }
+    }
+
+public:
+    explicit Shoe(int decks = 1, double penetration = 1.0) : top(0), cutCard(52), rng(std::random_device{}()) {
+        setDecks(decks, penetration);
+    }
+
+    // Use a shoe of several decks, reshuffled after penetration (0-1] of it is dealt
+    void setDecks(int decks, double penetration) {
+        cards.resize(std::max(decks, 1) * 52);
+        cutCard = std::max(1, static_cast<int>(cards.size() * std::min(std::max(penetration, 0.0), 1.0)));
+        shuffle();
+    }
+
+    // Shuffle a fresh shoe using Mersenne Twister
+    void shuffle() {
+        reset();
+        std::shuffle(cards.begin(), cards.end(), rng);
+        restart();
+    }
+
+    // Restart from a fresh shoe with a fixed seed so the same shoes come out again
+    // The antithetic shoe is the same shuffle with every rank mirrored (Ace<->King,
+    // 2<->Queen, ... 7 stays), so low cards become high ones and vice versa
+    void seed(uint32_t value, bool antithetic = false) {
+        rng.seed(value);
+        reset();
+        std::shuffle(cards.begin(), cards.end(), rng);
+        if (antithetic) {
+            for (auto& card : cards) {
+                card = static_cast<uint8_t>((card & 0xF0) | (14 - (card & 15)));
+            }
+        }
+        restart();
+    }
+
+    // Take size() packed cards in the same order as data() as the new shoe
+    // Every byte must pass Cards::isValidPacked(), check outside data before loading it
+    void load(const uint8_t* packed) {
+        std::memcpy(cards.data(), packed, cards.size());
+        restart();
+    }
+
+    // Deal again from the first card and forget dealt cards
+    void restart() {
+        top = 0;
+        dealtCards.reset();
+    }
+
+    // True when the cut card has come out or the shoe is empty
+    bool needsShuffle() const {
+        return top >= cutCard || top >= size();
+    }
+
+    // Deal a card and track it, shuffling first when the cut card has come out
+    Cards deal() {
+        if (needsShuffle()) shuffle();
+        uint8_t packed = cards[cards.size() - 1 - top++];
+        dealtCards.set(packed);
+        return Cards::unpack(packed);
+    }
+
+    // Count the cards still to be dealt by Blackjack value, counts[1] is aces and
+    // counts[10] holds tens and face cards
+    void remainingCounts(int counts[11]) const {
+        std::fill(counts, counts + 11, 0);
+        for (int i = 0; i < size() - top; i++) {
+            counts[Cards::unpack(cards[i]).getValue()]++;
+        }
+    }
+
+    // Check if a card has been dealt
+    bool isCardDealt(const Cards& card) const {
+        return dealtCards.test(card.pack());
+    }
+
+    // The shoe in deck order, packed, dealing runs from the back
+    const uint8_t* data() const {
+        return cards.data();
+    }
+
+    int size() const {
+        return static_cast<int>(cards.size());
+    }
+
+    int dealt() const {
+        return top;
+    }
+
+    // Carry on as if count cards had been dealt from the current order, for loading snapshots
+    void setDealt(int count) {
+        restart();
+        while (top < std::min(std::max(count, 0), size())) {
+            dealtCards.set(cards[cards.size() - 1 - top++]);
+        }
+    }
+
+    std::mt19937& generator() {
+        return rng;
+    }
+
+    const std::mt19937& generator() const {
+        return rng;
+    }
+};
+
+// Hand class represents a player's or dealer's hand
+// The total and the sorted display order are updated as each card is added, so
+// getValue() is a couple of additions and printing never sorts. Blackjack2 prints
+// hands sorted with display(), Blackjack1 in dealing order with displayDealt().
+class Hand {
+public:
+    static constexpr int maxCards = 10; // A hand never holds more, later cards are ignored
+
+private:
+    std::array<Cards, maxCards> cards; // Cards in hand in dealing order
+    std::array<uint8_t, maxCards> order; // Positions in cards sorted by value then suit, for display
+    int count; // Number of cards in use
+    int hardTotal; // Sum with every ace counted as 1
+    int aces; // Number of aces
+
+public:
+    constexpr Hand() : cards{}, order{}, count(0), hardTotal(0), aces(0) {}
+
+    // Add a card to the hand, inserting it into the display order
+    constexpr void addCard(Cards card) {
+        if (count < maxCards) {
+            int slot = count;
+            while (slot > 0) {
+                const Cards& before = cards[order[slot - 1]];
+                if (before.getRawValue() < card.getRawValue() ||
+                    (before.getRawValue() == card.getRawValue() && before.getSuit() <= card.getSuit()))
+                    break;
+                order[slot] = order[slot - 1];
+                slot--;
+            }
+            order[slot] = static_cast<uint8_t>(count);
+            cards[count++] = card;
+            hardTotal += card.getValue();
+            aces += card.getValue() == 1;
+        }
+    }
+
+    // Calculate the hand's Blackjack value, one ace counts 11 if that stays at 21 or under
+    int getValue() const {
+        return hardTotal + (isSoft() ? 10 : 0);
+    }
+
+    // A soft hand counts an ace as 11 without going over 21
+    bool isSoft() const {
+        return aces > 0 && hardTotal + 10 <= 21;
+    }
+
+    // Check if hand is bust
+    bool isBust() const {
+        return getValue() > 21;
+    }
+
+    // Check if hand is Blackjack
+    bool isBlackjack() const {
+        return getValue() == 21;
+    }
+
+    // Clear the hand
+    void clear() {
+        count = 0;
+        hardTotal = 0;
+        aces = 0;
+    }
+
+    // Card at a position in dealing order, e.g. the dealer's up card is getCard(0)
+    constexpr const Cards& getCard(int index) const {
+        return cards[index];
+    }
+
+    int size() const {
+        return count;
+    }
+
+    // Display hand in value then suit order, to a stream or a ScreenBuffer
+    // hideFirst hides the first card in that order
+    template <typename Out>
+    void display(bool hideFirst, Out& out) const {
+        for (int i = 0, shown = std::min(count, maxCards); i < shown; i++) {
+            if (i == 0 && hideFirst)
+                out << "[Hidden]";
+            else
+                out << cards[order[i]].nameEntry();
+            out << "... ";
+        }
+    }
+
+    void display(bool hideFirst = false) const {
+        display(hideFirst, std::cout);
+    }
+
+    // Display hand in dealing order, hideFirst hides the hole card, getCard(0)
+    template <typename Out>
+    constexpr void displayDealt(bool hideFirst, Out& out) const {
+        for (int i = 0, shown = std::min(count, maxCards); i < shown; i++) {
+            if (i == 0 && hideFirst)
+                out << "[Hidden]";
+            else
+                out << cards[i].nameEntry();
+            out << "... ";
+        }
+    }
+
+    void displayDealt(bool hideFirst = false) const {
+        displayDealt(hideFirst, std::cout);
+    }
+};
+
+// Fixed size text for checking what a hand prints at compile time
+struct HandText {
+    char text[128] = {};
+    int length = 0;
+
+    constexpr HandText& operator<<(std::string_view part) {
+        for (char c : part) text[length++] = c;
+        return *this;
+    }
+
+    constexpr HandText& operator<<(const CardName& name) {
+        return *this << name.view();
+    }
+};
+
+// The dealer's hole card is dealt first: a King then a 2 must show as the 2 alone,
+// although the 2 comes first in display() order
+constexpr bool hidesHoleCard() {
+    Hand hand;
+    hand.addCard(Cards(13, 'S'));
+    hand.addCard(Cards(2, 'H'));
+    HandText out;
+    hand.displayDealt(true, out);
+    return hand.getCard(0) == Cards(13, 'S') && std::string_view(out.text, out.length) == "[Hidden]... 2 of Hearts... ";
+}
+static_assert(hidesHoleCard(), "displayDealt() hides getCard(0), the hole card");
+
+#endif
@@ -10,17 +10,144 @@
 #include <ctime>
 #include <string>
 #include <iomanip>
+#include <sstream>
+#include <fstream>
+#include <chrono>
+#include <new>
+#include <cstring>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <numeric>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <memory>
+#include <future>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
 using namespace std;
 
+//Heap allocation counter, bumped by the operator new replacement below
+//Kept per thread so the search and service threads do not race on it
+static thread_local size_t allocCount=0;
+
+//All replaced forms go through these two out of line helpers, so the compiler
+//never sees an inlined malloc() paired with a delete expression
+__attribute__((noinline)) void* allocCounted(size_t size,size_t align=0){
+    allocCount++;
+    if(!size)size=1;
+    void* p=align>alignof(max_align_t)?aligned_alloc(align,(size+align-1)/align*align):malloc(size);
+    if(!p)throw bad_alloc();
+    return p;
+}
+__attribute__((noinline)) void freeCounted(void* p) noexcept{free(p);}
+
+void* operator new(size_t size){return allocCounted(size);}
+void* operator new[](size_t size){return allocCounted(size);}
+void* operator new(size_t size,align_val_t a){return allocCounted(size,(size_t)a);}
+void* operator new[](size_t size,align_val_t a){return allocCounted(size,(size_t)a);}
+void operator delete(void* p) noexcept{freeCounted(p);}
+void operator delete[](void* p) noexcept{freeCounted(p);}
+void operator delete(void* p,size_t) noexcept{freeCounted(p);}
+void operator delete[](void* p,size_t) noexcept{freeCounted(p);}
+void operator delete(void* p,align_val_t) noexcept{freeCounted(p);}
+void operator delete[](void* p,align_val_t) noexcept{freeCounted(p);}
+void operator delete(void* p,size_t,align_val_t) noexcept{freeCounted(p);}
+void operator delete[](void* p,size_t,align_val_t) noexcept{freeCounted(p);}
+
+//Digits and digit counts of all 10000 codes, code 3815 is digit {3,8,1,5}
+struct CodeTable{
+    unsigned char digit[10000][4];
+    unsigned char count[10000][10];
+    CodeTable(){
+        memset(count,0,sizeof(count));
+        for(int c=0;c<10000;c++){
+            for(int i=3,v=c;i>=0;i--,v/=10){
+                digit[c][i]=v%10;
+                count[c][v%10]++;
+            }
+        }
+    }
+};
+static const CodeTable table;
+
 //Function Prototypes
-string AI(char,char);
+struct AIState;
+string AI(char,char,bool=false);
+string AI(char,char,AIState &);
 bool eval(string,string,char &,char &);
 string set();
+void bench(const char *);
+int score(int,int);
+vector<short> representatives(const vector<short> &);
+string search(char,char,double,int,bool=false);
+void searchGames(double,int,int);
+int adversaryAnswer(vector<short> &,const string &);
+void adversaryGame(bool,double,int);
+int firstFit(int);
+void batchGames(int);
+void serve(const char *,int,double);
+void client(const char *,int,int,bool);
 
 int main(int argc, char** argv) {
     //Set the random number seed
     srand(static_cast<unsigned int>(time(0)));
     
+    //Benchmark mode, optional second argument is a CSV output file
+    if(argc>1&&strcmp(argv[1],"--bench")==0){
+        bench(argc>2?argv[2]:nullptr);
+        return 0;
+    }
+    
+    //Anytime search mode, build with -pthread
+    //--search [ms per guess] [games] [threads], one game prints every guess
+    if(argc>1&&strcmp(argv[1],"--search")==0){
+        double budget=argc>2?atof(argv[2]):10;
+        int games=argc>3?max(atoi(argv[3]),1):1;
+        int nThread=argc>4?max(atoi(argv[4]),1):
+                    static_cast<int>(max(1u,thread::hardware_concurrency()));
+        searchGames(budget>0?budget:10,games,nThread);
+        return 0;
+    }
+    
+    //Worst case mode, the codemaker answers to keep the most codes possible
+    //--adversary [ai|search] [ms per guess] [threads]
+    if(argc>1&&strcmp(argv[1],"--adversary")==0){
+        bool useSearch=argc>2&&strcmp(argv[2],"search")==0;
+        double budget=argc>3?atof(argv[3]):10;
+        int nThread=argc>4?max(atoi(argv[4]),1):
+                    static_cast<int>(max(1u,thread::hardware_concurrency()));
+        adversaryGame(useSearch,budget>0?budget:10,nThread);
+        return 0;
+    }
+    
+    //Batch mode, solves many games at once and compares with one at a time
+    //--batch [games], the default of 10000 plays every code once
+    if(argc>1&&strcmp(argv[1],"--batch")==0){
+        batchGames(argc>2?max(atoi(argv[2]),1):10000);
+        return 0;
+    }
+    
+    //Solving service on a Unix domain socket, runs until killed or for seconds
+    //--serve [socket] [threads] [seconds]
+    //and a load generator that plays games through it
+    //--client [socket] [games] [connections] [ai|fit]
+    if(argc>1&&strcmp(argv[1],"--serve")==0){
+        int nThread=argc>3?max(atoi(argv[3]),1):
+                    static_cast<int>(max(1u,thread::hardware_concurrency()));
+        serve(argc>2?argv[2]:"mastermind.sock",nThread,argc>4?atof(argv[4]):0);
+        return 0;
+    }
+    if(argc>1&&strcmp(argv[1],"--client")==0){
+        client(argc>2?argv[2]:"mastermind.sock",argc>3?max(atoi(argv[3]),1):1000,
+               argc>4?max(atoi(argv[4]),1):4,argc>5&&strcmp(argv[5],"ai")==0);
+        return 0;
+    }
+    
     //Declare variables
     string code,guess;  //code to break, and current guess
     char rr,rw;         //right digit in right place vs. wrong place
@@ -49,23 +176,38 @@ int main(int argc, char** argv) {
 }
 
 
-string AI(char rr,char rw){
-
-    // A mess of variables...
-        static string nextGuess = "0000",
-                      finalGuess = "0000",
-                      marked = "    ";
+//Everything AI() remembers between guesses, one per game so several games
+//can be played at once. It used to live in static variables inside AI().
+struct AIState{
+    string nextGuess,finalGuess,marked;
+    int guess,found,testValue,nextDigit,first,second,third,fourth,
+        testPhase1,testPhase2,testPhase3,testPhase4,
+        attemptsPhase2,attemptsPhase3,attemptsPhase4;
+    bool confirmed[4],second2;
+    ostream *log;       //AI() prints its working here, nullptr keeps it quiet
+    AIState():nextGuess("0000"),finalGuess("0000"),marked("    "),
+        guess(0),found(0),testValue(-1),nextDigit(0),
+        first(-1),second(-1),third(-1),fourth(-1),
+        testPhase1(0),testPhase2(0),testPhase3(0),testPhase4(0),
+        attemptsPhase2(0),attemptsPhase3(0),attemptsPhase4(0),
+        confirmed{false,false,false,false},second2(false),log(&cout){}
+};
 
-        static int guess = 0, found = 0, testValue = -1, nextDigit = 0,
-                   first = -1, second = -1, third = -1, fourth = -1,
-                   testPhase1 = 0, testPhase2 = 0, testPhase3 = 0, testPhase4 = 0,
-                   attemptsPhase2 = 0, attemptsPhase3 = 0, attemptsPhase4 = 0;
+//The original single game interface, reset starts a new game
+string AI(char rr,char rw,bool reset){
+    static AIState state;
+    if(reset){
+        state=AIState();
+        return state.nextGuess;
+    }
+    return AI(rr,rw,state);
+}
 
-        static bool confirmed[4] = {false, false, false, false},
-                    second2 = false;
+string AI(char rr,char rw,AIState &st){
 
         int correctDigit;
-        guess++;
+
+        st.guess++;
 
     // There is alot of unnecessary code because I was A) short on time with my other classes and B) scared to
     // ruin something and not be able to trace my way back to success
@@ -73,50 +215,50 @@ string AI(char rr,char rw){
     // This area of the function takes in the results of your last guess, if rr >=1 and all the spots are not filled
     // we enter and mark the spots were we have guessed values.
     // Here we also start setting up our finalGuess
-    if (found == 4 && static_cast<int>(rr) >= 1 && !(confirmed[0] && confirmed[1] && confirmed[2] && confirmed[3])){
+    if (st.found == 4 && static_cast<int>(rr) >= 1 && !(st.confirmed[0] && st.confirmed[1] && st.confirmed[2] && st.confirmed[3])){
         if (static_cast<int>(rr) == 1){
             
             for (int i = 0; i < 4; i++) {
-                if (nextGuess[i] != testValue + '0'){
-                    confirmed[i] = true;
-                    marked[i] = 'X';
-                    finalGuess[i] = nextGuess[i];
+                if (st.nextGuess[i] != st.testValue + '0'){
+                    st.confirmed[i] = true;
+                    st.marked[i] = 'X';
+                    st.finalGuess[i] = st.nextGuess[i];
                 }
             }
-            nextDigit++;
-            if (confirmed[0] && confirmed[1] && confirmed[2] && confirmed[3]){
-                nextGuess = finalGuess;
+            st.nextDigit++;
+            if (st.confirmed[0] && st.confirmed[1] && st.confirmed[2] && st.confirmed[3]){
+                st.nextGuess = st.finalGuess;
             }
         }
 
         if (static_cast<int>(rr) == 2){
 
             for (int i = 0; i < 4; i++) {
-                if (nextGuess[i] != testValue + '0'){
-                    confirmed[i] = true;
-                    marked[i] = 'X';
-                    finalGuess[i] = nextGuess[i];
+                if (st.nextGuess[i] != st.testValue + '0'){
+                    st.confirmed[i] = true;
+                    st.marked[i] = 'X';
+                    st.finalGuess[i] = st.nextGuess[i];
                 }
                 
             }
-            nextDigit += 2;
-            if (confirmed[0] && confirmed[1] && confirmed[2] && confirmed[3]){
-                nextGuess = finalGuess;
+            st.nextDigit += 2;
+            if (st.confirmed[0] && st.confirmed[1] && st.confirmed[2] && st.confirmed[3]){
+                st.nextGuess = st.finalGuess;
             }
         }
 
         if (static_cast<int>(rr) == 3){
 
             for (int i = 0; i < 4; i++) {
-                if (nextGuess[i] != testValue + '0'){
-                    confirmed[i] = true;
-                    marked[i] = 'X';
-                    finalGuess[i] = nextGuess[i];
+                if (st.nextGuess[i] != st.testValue + '0'){
+                    st.confirmed[i] = true;
+                    st.marked[i] = 'X';
+                    st.finalGuess[i] = st.nextGuess[i];
                 }
             }
-            nextDigit += 3;
-            if (confirmed[0] && confirmed[1] && confirmed[2] && confirmed[3]){
-                nextGuess = finalGuess;
+            st.nextDigit += 3;
+            if (st.confirmed[0] && st.confirmed[1] && st.confirmed[2] && st.confirmed[3]){
+                st.nextGuess = st.finalGuess;
             }
         }
     }
@@ -124,92 +266,92 @@ string AI(char rr,char rw){
     // Functions starts here, it initially starts at '0000' loops through to 9999 until all the digits are found
     // When rr > 1 we found a digit and save it and place it in variables. 
     // Found gets incremente when we find values so once all values are found this if staments ends
-    if (found < 4){
+    if (st.found < 4){
 
         if (static_cast<int>(rr) >= 1){
-            found++;
-            if (found == 1){
-                correctDigit = (((stoi(nextGuess)%1000)%100)%10);
-                first = correctDigit;
+            st.found++;
+            if (st.found == 1){
+                correctDigit = (((stoi(st.nextGuess)%1000)%100)%10);
+                st.first = correctDigit;
 
                 if (static_cast<int>(rr) == 2){
-                    first = correctDigit;
-                    second = correctDigit;
-                    found++;
+                    st.first = correctDigit;
+                    st.second = correctDigit;
+                    st.found++;
                 }
                 if (static_cast<int>(rr) == 3){
-                    first = correctDigit;
-                    second = correctDigit;
-                    third = correctDigit;
-                    found += 2;
+                    st.first = correctDigit;
+                    st.second = correctDigit;
+                    st.third = correctDigit;
+                    st.found += 2;
                 }
             }
-            else if (found == 2){
-                correctDigit = (((stoi(nextGuess)%1000)%100)%10);
-                second = correctDigit;
+            else if (st.found == 2){
+                correctDigit = (((stoi(st.nextGuess)%1000)%100)%10);
+                st.second = correctDigit;
 
                 if (static_cast<int>(rr) == 2){
-                    second = correctDigit;
-                    third = correctDigit;
-                    found++;
+                    st.second = correctDigit;
+                    st.third = correctDigit;
+                    st.found++;
                 }
                 if (static_cast<int>(rr) == 3){
-                    second = correctDigit;
-                    third = correctDigit;
-                    fourth = correctDigit;
-                    found += 2;
+                    st.second = correctDigit;
+                    st.third = correctDigit;
+                    st.fourth = correctDigit;
+                    st.found += 2;
                 }
             }
-            else if (found == 3){
-                correctDigit = (((stoi(nextGuess)%1000)%100)%10);
-                third = correctDigit;
+            else if (st.found == 3){
+                correctDigit = (((stoi(st.nextGuess)%1000)%100)%10);
+                st.third = correctDigit;
 
                 if (static_cast<int>(rr) == 2){
-                    third = correctDigit;
-                    fourth = correctDigit;
-                    found++;
+                    st.third = correctDigit;
+                    st.fourth = correctDigit;
+                    st.found++;
                 }
                 if (static_cast<int>(rr) == 3){
-                    found += 2;
+                    st.found += 2;
                 }
             }
-            else if (found == 4 && fourth == -1){
-                correctDigit = (((stoi(nextGuess)%1000)%100)%10);
-                fourth = correctDigit;
+            else if (st.found == 4 && st.fourth == -1){
+                correctDigit = (((stoi(st.nextGuess)%1000)%100)%10);
+                st.fourth = correctDigit;
 
                 if (static_cast<int>(rr) == 2){
-                    found++;
+                    st.found++;
                 }
                 if (static_cast<int>(rr) == 3){
-                    found += 2;
+                    st.found += 2;
                 }
             }
         }
         
-        if (guess < 10){
-            if (guess==1)
-                nextGuess = "0000";
-            else if (guess >=2 && guess<=9)
-                for (int i=0; i<nextGuess.length(); i++){
-                    nextGuess[i] +=1;
+        if (st.guess < 10){
+            if (st.guess==1)
+                st.nextGuess = "0000";
+            else if (st.guess >=2 && st.guess<=9)
+                for (int i=0; i<st.nextGuess.length(); i++){
+                    st.nextGuess[i] +=1;
                 }
         }
 
-        else if (guess == 10 && found < 4){ 
-            if (found == 3){
-                fourth = 9;
-                found = 4;
+        else if (st.guess == 10 && st.found < 4){ 
+            if (st.found == 3){
+                st.fourth = 9;
+                st.found = 4;
             }
-            if (found == 2){
-                third = 9;
-                fourth = 9;
-                found = 4;
+            if (st.found == 2){
+                st.third = 9;
+                st.fourth = 9;
+                st.found = 4;
             }
-            if (found == 1){
-                second = 9;
-                third = 9;
-                fourth = 9;
-                found = 4;
+            if (st.found == 1){
+                st.second = 9;
+                st.third = 9;
+                st.fourth = 9;
+                st.found = 4;
             }
         }
     }
@@ -220,99 +362,99 @@ string AI(char rr,char rw){
     // and here we test to see if the next position we will be testing is marked, if it is, it moves to the next
     // postion. It also keeps track of attempts per each spot to ensure the minimum number of attempts.
     // If on the last digit, the digit is set to the empty spot and the nextGuess is set to finalGuess.
-    if (found == 4 && !(confirmed[0] && confirmed[1] && confirmed[2] && confirmed[3])){
+    if (st.found == 4 && !(st.confirmed[0] && st.confirmed[1] && st.confirmed[2] && st.confirmed[3])){
 
-        if (nextDigit == 0){
-            int positionIndex = testPhase1 % 4;
+        if (st.nextDigit == 0){
+            int positionIndex = st.testPhase1 % 4;
             for (int i = 0; i < 4; i++) {
-                nextGuess[i] = (i == positionIndex) ? (first + '0') : (testValue + '0');
+                st.nextGuess[i] = (i == positionIndex) ? (st.first + '0') : (st.testValue + '0');
             }
             if (positionIndex == 3){
-                finalGuess[testPhase1] = first + '0';
-                nextDigit++;
+                st.finalGuess[st.testPhase1] = st.first + '0';
+                st.nextDigit++;
             }
-            cout<<nextGuess<<endl;
-            testPhase1++;
+            if(st.log)*st.log<<st.nextGuess<<endl;
+            st.testPhase1++;
         }
-        if (nextDigit == 1){
-            int positionIndex = testPhase2 % 4;
-            if (marked[positionIndex]=='X'){
+        if (st.nextDigit == 1){
+            int positionIndex = st.testPhase2 % 4;
+            if (st.marked[positionIndex]=='X'){
                 positionIndex++;
-                testPhase2++;
-                if (marked[positionIndex]=='X'){
+                st.testPhase2++;
+                if (st.marked[positionIndex]=='X'){
                     positionIndex++;
-                    testPhase2++;
-                    if (marked[positionIndex]=='X'){
+                    st.testPhase2++;
+                    if (st.marked[positionIndex]=='X'){
                         positionIndex++;
-                        testPhase2++;
+                        st.testPhase2++;
                     }
                 }
             }
             for (int i = 0; i < 4; i++) {
-                nextGuess[i] = (i == positionIndex) ? (second + '0') : (testValue + '0');
+                st.nextGuess[i] = (i == positionIndex) ? (st.second + '0') : (st.testValue + '0');
             }
-            if (attemptsPhase2 == 2){
-                finalGuess[positionIndex] = second + '0';
-                nextDigit++;
+            if (st.attemptsPhase2 == 2){
+                st.finalGuess[positionIndex] = st.second + '0';
+                st.nextDigit++;
             }
-            cout<<nextGuess<<endl;
-            attemptsPhase2++;
-            testPhase2++;
+            if(st.log)*st.log<<st.nextGuess<<endl;
+            st.attemptsPhase2++;
+            st.testPhase2++;
         }
-        if (nextDigit == 2){
-            int positionIndex = testPhase3 % 4;
-            cout<<attemptsPhase3<<endl;
-            if (marked[positionIndex]=='X'){
+        if (st.nextDigit == 2){
+            int positionIndex = st.testPhase3 % 4;
+            if(st.log)*st.log<<st.attemptsPhase3<<endl;
+            if (st.marked[positionIndex]=='X'){
                 positionIndex++;
-                testPhase3++;
-                if (marked[positionIndex]=='X'){
+                st.testPhase3++;
+                if (st.marked[positionIndex]=='X'){
                     positionIndex++;
-                    testPhase3++;
-                    if (marked[positionIndex]=='X'){
+                    st.testPhase3++;
+                    if (st.marked[positionIndex]=='X'){
                         positionIndex++;
-                        testPhase3++;
+                        st.testPhase3++;
                     }
                 }
             }
             for (int i = 0; i < 4; i++) {
-                nextGuess[i] = (i == positionIndex) ? (third + '0') : (testValue + '0');
+                st.nextGuess[i] = (i == positionIndex) ? (st.third + '0') : (st.testValue + '0');
             }
             
-            if (attemptsPhase3 == 1){
-                finalGuess[positionIndex] = third + '0';
-                nextDigit++;
-            }
-            cout<<finalGuess<<endl;
-            cout<<nextGuess<<endl;
-            attemptsPhase3++;
-            testPhase3++;
-        }
-        if (nextDigit == 3){
-            int positionIndex = testPhase4 % 4;
-            if (marked[positionIndex]=='X'){
+            if (st.attemptsPhase3 == 1){
+                st.finalGuess[positionIndex] = st.third + '0';
+                st.nextDigit++;
+            }
+            if(st.log)*st.log<<st.finalGuess<<endl;
+            if(st.log)*st.log<<st.nextGuess<<endl;
+            st.attemptsPhase3++;
+            st.testPhase3++;
+        }
+        if (st.nextDigit == 3){
+            int positionIndex = st.testPhase4 % 4;
+            if (st.marked[positionIndex]=='X'){
                 positionIndex++;
-                testPhase4++;
-                if (marked[positionIndex]=='X'){
+                st.testPhase4++;
+                if (st.marked[positionIndex]=='X'){
                     positionIndex++;
-                    testPhase4++;
-                    if (marked[positionIndex]=='X'){
+                    st.testPhase4++;
+                    if (st.marked[positionIndex]=='X'){
                         positionIndex++;
-                        testPhase4++;
+                        st.testPhase4++;
                     }
                 }
             }
             for (int i = 0; i < 4; i++) {
-                nextGuess[i] = (i == positionIndex) ? (fourth + '0') : (testValue + '0');
+                st.nextGuess[i] = (i == positionIndex) ? (st.fourth + '0') : (st.testValue + '0');
             }
-            if (attemptsPhase4 == 0){
-                finalGuess[positionIndex] = fourth + '0';
-                nextDigit++;
+            if (st.attemptsPhase4 == 0){
+                st.finalGuess[positionIndex] = st.fourth + '0';
+                st.nextDigit++;
             }
-            nextGuess = finalGuess;
+            st.nextGuess = st.finalGuess;
         }
     }
     
-    return nextGuess;
+    return st.nextGuess;
 }
 
 
@@ -350,3 +492,923 @@ string set(){
     }
     return code;
 }
+
+//Score guess a against code b from the tables, right place*5 + wrong place
+//Right digits overall is the sum of the smaller count of each digit
+int score(int a,int b){
+    const unsigned char *da=table.digit[a],*db=table.digit[b];
+    const unsigned char *ca=table.count[a],*cb=table.count[b];
+    int rr=(da[0]==db[0])+(da[1]==db[1])+(da[2]==db[2])+(da[3]==db[3]);
+    int common=0;
+    for(int d=0;d<10;d++)common+=min(ca[d],cb[d]);
+    return rr*5+common-rr;
+}
+
+//One representative guess for every symmetry class left by the guesses so far
+//Renaming digits and reordering positions does not change the game, so a
+//renaming that leaves every earlier guess as it was also maps the codes still
+//possible onto themselves, and two guesses it turns into each other split them
+//the same way. Only one guess per class needs scoring. Digits never guessed
+//can trade places freely, the others only as the earlier guesses allow. A guess
+//is kept when no allowed position order, with the digits never guessed renamed
+//to the smallest free ones in order of appearance, makes it a smaller code.
+//On the first move that leaves 5 guesses out of 10000.
+vector<short> representatives(const vector<short> &history){
+    static vector<short> opening;   //No history, every game starts the same
+    if(history.empty()&&!opening.empty())return opening;
+    
+    bool used[10]={false};
+    for(short g:history){
+        for(int i=0;i<4;i++)used[table.digit[g][i]]=true;
+    }
+    int free[10],nFree=0;
+    for(int d=0;d<10;d++)if(!used[d])free[nFree++]=d;
+    
+    //Position orders that some renaming of the guessed digits agrees with
+    //Position i of the image takes the digit at position pos[i]
+    struct Symmetry{int pos[4];signed char digit[10];};
+    vector<Symmetry> sym;
+    int pos[4]={0,1,2,3};
+    do{
+        Symmetry s;
+        signed char from[10];
+        memcpy(s.pos,pos,sizeof(pos));
+        memset(s.digit,-1,sizeof(s.digit));
+        memset(from,-1,sizeof(from));
+        bool ok=true;
+        for(size_t k=0;k<history.size()&&ok;k++){
+            const unsigned char *g=table.digit[history[k]];
+            for(int i=0;i<4&&ok;i++){
+                int a=g[pos[i]],b=g[i];
+                if(s.digit[a]<0&&from[b]<0){
+                    s.digit[a]=b;
+                    from[b]=a;
+                }else if(s.digit[a]!=b){
+                    ok=false;
+                }
+            }
+        }
+        if(ok)sym.push_back(s);
+    }while(next_permutation(pos,pos+4));
+    
+    //Nothing to collapse once only the identity is left
+    vector<short> reps;
+    if(sym.size()==1&&nFree<=1){
+        reps.resize(10000);
+        iota(reps.begin(),reps.end(),0);
+        return reps;
+    }
+    for(int c=0;c<10000;c++){
+        const unsigned char *d=table.digit[c];
+        bool keep=true;
+        for(size_t k=0;k<sym.size()&&keep;k++){
+            const Symmetry &s=sym[k];
+            signed char rename[10];
+            memset(rename,-1,sizeof(rename));
+            int next=0,image=0;
+            for(int i=0;i<4;i++){
+                int x=d[s.pos[i]];
+                if(used[x])x=s.digit[x];
+                else{
+                    if(rename[x]<0)rename[x]=free[next++];
+                    x=rename[x];
+                }
+                image=image*10+x;
+            }
+            keep=image>=c;
+        }
+        if(keep)reps.push_back(c);
+    }
+    if(history.empty())opening=reps;
+    return reps;
+}
+
+//Anytime guess search, rr and rw answer the previous guess like AI()
+//Keeps every code that still fits all the answers and picks the guess that
+//leaves the fewest of them on average (sum of the squared answer group sizes).
+//Scoring a guess costs one score() per remaining code, far too much to try all
+//10000 guesses on the first moves, so the guesses are dealt out to nThread
+//threads that each stop when budget ms have passed. Codes that still fit are
+//tried first and one of them is the starting answer, so there is always a
+//legal best-so-far guess to return when time runs out. Only one guess of each
+//symmetry class is tried, see representatives().
+string search(char rr,char rw,double budget,int nThread,bool reset){
+    static vector<short> left;  //Codes consistent with every answer so far
+    static vector<short> history;   //Guesses so far
+    static int last=-1;         //Previous guess, -1 before the first one
+    
+    if(reset){
+        left.clear();
+        history.clear();
+        last=-1;
+        return "0000";
+    }
+    if(last<0){
+        left.resize(10000);
+        iota(left.begin(),left.end(),0);
+    }else{
+        int answer=rr*5+rw;
+        left.erase(remove_if(left.begin(),left.end(),
+            [answer](short c){return score(last,c)!=answer;}),left.end());
+        //Only a wrong answer can empty the list, start over rather than fail
+        if(left.empty()){
+            left.resize(10000);
+            iota(left.begin(),left.end(),0);
+        }
+    }
+    
+    //Guesses in the order they are tried, the consistent ones first
+    //A symmetry maps the remaining codes onto themselves, so a class is either
+    //all consistent or all not
+    vector<bool> inLeft(10000,false);
+    for(short c:left)inLeft[c]=true;
+    vector<short> reps=representatives(history),order;
+    for(short c:reps)if(inLeft[c])order.push_back(c);
+    size_t nFit=order.size();
+    for(short c:reps)if(!inLeft[c])order.push_back(c);
+    
+    //Lowest cost any guess can have: a consistent guess splitting the rest apart
+    long long floor=static_cast<long long>(left.size())-1;
+    auto stop=chrono::steady_clock::now()+chrono::duration<double,milli>(budget);
+    atomic<bool> done(left.size()<=2);
+    
+    //Each thread keeps its own best so they never wait on each other
+    if(left.size()<64)nThread=1;
+    vector<long long> bestCost(nThread,-1);
+    vector<int> bestGuess(nThread,nFit>0?order[0]:left[0]);
+    auto work=[&](int t){
+        for(size_t i=t;i<order.size()&&!done.load(memory_order_relaxed);i+=nThread){
+            if(chrono::steady_clock::now()>=stop)break;
+            int size[25]={0};
+            for(short c:left)size[score(order[i],c)]++;
+            size[20]=0;         //4 right places wins, nothing is left
+            long long cost=0;
+            for(int k=0;k<25;k++)cost+=size[k]*size[k];
+            if(bestCost[t]<0||cost<bestCost[t]){
+                bestCost[t]=cost;
+                bestGuess[t]=order[i];
+                if(cost==floor)done=true;
+            }
+        }
+    };
+    vector<thread> pool;
+    for(int t=1;t<nThread;t++)pool.emplace_back(work,t);
+    work(0);
+    for(auto &th:pool)th.join();
+    
+    //Lowest cost wins, ties go to the guess tried first
+    last=bestGuess[0];
+    long long cost=-1;
+    size_t rank=order.size();
+    for(int t=0;t<nThread;t++){
+        if(bestCost[t]<0)continue;
+        size_t r=find(order.begin(),order.end(),bestGuess[t])-order.begin();
+        if(cost<0||bestCost[t]<cost||(bestCost[t]==cost&&r<rank)){
+            cost=bestCost[t];
+            rank=r;
+            last=bestGuess[t];
+        }
+    }
+    history.push_back(last);
+    const unsigned char *d=table.digit[last];
+    string guess="0000";
+    for(int i=0;i<4;i++)guess[i]=d[i]+'0';
+    return guess;
+}
+
+//Play games with search(), one game shows every guess and more games
+//report the guess counts and the time each guess took
+void searchGames(double budget,int games,int nThread){
+    long long totGuess=0;
+    int maxGuess=0;
+    double totMs=0,maxMs=0;
+    for(int g=0;g<games;g++){
+        string code=set(),guess;
+        char rr=0,rw=0;
+        int n=0;
+        search(0,0,budget,nThread,true);
+        if(games==1)cout<<"The code is: "<<code<<endl;
+        do{
+            n++;
+            auto t0=chrono::steady_clock::now();
+            guess=search(rr,rw,budget,nThread);
+            double ms=chrono::duration<double,milli>(chrono::steady_clock::now()-t0).count();
+            totMs+=ms;
+            maxMs=max(maxMs,ms);
+            if(games==1)cout<<"Guess "<<n<<" guessing: "<<guess<<" ("
+                            <<fixed<<setprecision(2)<<ms<<" ms)"<<endl;
+        }while(eval(code,guess,rr,rw)&&n<50);
+        totGuess+=n;
+        maxGuess=max(maxGuess,n);
+    }
+    cout<<fixed<<setprecision(3);
+    cout<<games<<" games, "<<budget<<" ms budget, "<<nThread<<" threads"<<endl;
+    cout<<"Average guesses per game = "<<static_cast<double>(totGuess)/games
+        <<", most = "<<maxGuess<<endl;
+    cout<<"Time per guess: average "<<totMs/totGuess<<" ms, worst "<<maxMs<<" ms"<<endl;
+}
+
+//Adaptive codemaker, there is no code until the end: every guess gets the
+//answer that keeps the largest group of codes possible, and left narrows to that
+//group. Ties go to the smaller answer so the same solver always sees the same
+//game. Returns the answer as right place*5 + wrong place like score().
+//AI() fills untested places with '/', such guesses are scored with eval().
+int adversaryAnswer(vector<short> &left,const string &guess){
+    bool isCode=guess.size()==4&&all_of(guess.begin(),guess.end(),
+                                        [](char d){return d>='0'&&d<='9';});
+    int g=isCode?stoi(guess):0;
+    auto answer=[&](short c){
+        if(isCode)return score(g,c);
+        const unsigned char *d=table.digit[c];
+        string code="0000";
+        char rr,rw;
+        for(int i=0;i<4;i++)code[i]=d[i]+'0';
+        eval(code,guess,rr,rw);
+        return rr*5+rw;
+    };
+    int size[25]={0};
+    for(short c:left)size[answer(c)]++;
+    int worst=0;
+    for(int k=1;k<25;k++)if(size[k]>size[worst])worst=k;
+    left.erase(remove_if(left.begin(),left.end(),
+        [&](short c){return answer(c)!=worst;}),left.end());
+    return worst;
+}
+
+//Play AI() or search() against the adversary and report the guess count and
+//the time of each guess. AI() prints while it works so its output is dropped.
+void adversaryGame(bool useSearch,double budget,int nThread){
+    vector<short> left(10000);
+    iota(left.begin(),left.end(),0);
+    ostringstream quiet;
+    string guess;
+    char rr=0,rw=0;
+    int n=0;
+    double totMs=0,maxMs=0;
+    if(useSearch)search(0,0,budget,nThread,true);
+    else AI(0,0,true);
+    do{
+        n++;
+        auto t0=chrono::steady_clock::now();
+        if(useSearch){
+            guess=search(rr,rw,budget,nThread);
+        }else{
+            streambuf *old=cout.rdbuf(quiet.rdbuf());
+            guess=AI(rr,rw);
+            cout.rdbuf(old);
+            quiet.str("");
+        }
+        double ms=chrono::duration<double,milli>(chrono::steady_clock::now()-t0).count();
+        totMs+=ms;
+        maxMs=max(maxMs,ms);
+        int answer=adversaryAnswer(left,guess);
+        rr=answer/5;
+        rw=answer%5;
+        cout<<"Guess "<<n<<" guessing: "<<guess<<" right place "<<static_cast<int>(rr)
+            <<", wrong place "<<static_cast<int>(rw)<<", "<<left.size()<<" codes left"<<endl;
+    }while(rr!=4&&n<50);
+    cout<<fixed<<setprecision(3);
+    cout<<(useSearch?"search":"AI")<<" against the adversary: "<<n<<" guesses"
+        <<(rr==4?"":" without finding the code")<<endl;
+    cout<<"Time per guess: average "<<totMs/n<<" ms, worst "<<maxMs<<" ms"<<endl;
+}
+
+//First fit tries codes in the order i*fitStep%10000, a fixed scramble of the
+//codes, because in counting order it spends its early guesses on 0000, 0001...
+//and needs 8.7 guesses a game instead of 6.7. 3571 is prime so every code comes up.
+const int fitStep=3571;
+
+//One game with the first fit strategy: always guess the first code in fitStep
+//order that fits every answer so far. Any code before the last guess was
+//already ruled out, so the guesses only ever move forward. Returns the number
+//of guesses.
+int firstFit(int secret){
+    int guess[16],answer[16],n=0;
+    for(int i=0;i<10000;i++){
+        int c=i*fitStep%10000;
+        bool fits=true;
+        for(int k=0;k<n&&fits;k++)fits=score(guess[k],c)==answer[k];
+        if(!fits)continue;
+        int a=score(c,secret);
+        if(a==20)return n+1;
+        if(n<16){
+            guess[n]=c;
+            answer[n++]=a;
+        }
+    }
+    return n;
+}
+
+//Many first fit games at once, one game per lane of byte arrays
+//Since first fit guesses only move forward, every game can take its guesses from one
+//shared sweep over the codes: code c becomes the next guess of each game whose
+//answers it fits. Testing c against entry k of every game's history is one loop
+//over the lanes with c the same for all, which the compiler turns into SIMD code
+//that tests a vector of games per instruction (build with -O3). Solved games
+//swap with the last lane so the loops only cover games still playing.
+struct GameBatch{
+    static const int maxGuess=16;
+    int lanes,n;                    //Allocated lanes and games still playing
+    vector<short> secret;           //Code each lane has to find
+    vector<int> game;               //Game number in each lane
+    vector<unsigned char> digit;    //Guess digits, (k*4+position)*lanes+lane
+    vector<unsigned char> count;    //Guess digit counts, (k*10+digit)*lanes+lane
+    vector<unsigned char> answer;   //Answer to guess k, k*lanes+lane
+    vector<unsigned char> len;      //Guesses made in each lane
+    vector<unsigned char> fits;     //Code under test fits the lane's answers
+    
+    GameBatch(const vector<short> &codes):lanes(codes.size()),n(codes.size()),
+        secret(codes),game(codes.size()),digit(maxGuess*4*codes.size()),
+        count(maxGuess*10*codes.size()),answer(maxGuess*codes.size()),
+        len(codes.size(),0),fits(codes.size()){
+        iota(game.begin(),game.end(),0);
+    }
+    
+    //Clear fits for lanes whose guess k gives code c another answer than it got
+    static void fitKernel(int n,int k,const unsigned char *cd,const unsigned char *cc,
+                          const unsigned char *__restrict d0,const unsigned char *__restrict d1,
+                          const unsigned char *__restrict d2,const unsigned char *__restrict d3,
+                          const unsigned char *__restrict cnt,size_t stride,
+                          const unsigned char *__restrict ans,const unsigned char *__restrict len,
+                          unsigned char *__restrict fits){
+        const unsigned char c0=cd[0],c1=cd[1],c2=cd[2],c3=cd[3];
+        unsigned char cc0=cc[0],cc1=cc[1],cc2=cc[2],cc3=cc[3],cc4=cc[4],
+                      cc5=cc[5],cc6=cc[6],cc7=cc[7],cc8=cc[8],cc9=cc[9];
+        for(int l=0;l<n;l++){
+            unsigned char rr=(d0[l]==c0)+(d1[l]==c1)+(d2[l]==c2)+(d3[l]==c3);
+            unsigned char common=min(cnt[l],cc0)+min(cnt[stride+l],cc1)
+                +min(cnt[2*stride+l],cc2)+min(cnt[3*stride+l],cc3)
+                +min(cnt[4*stride+l],cc4)+min(cnt[5*stride+l],cc5)
+                +min(cnt[6*stride+l],cc6)+min(cnt[7*stride+l],cc7)
+                +min(cnt[8*stride+l],cc8)+min(cnt[9*stride+l],cc9);
+            unsigned char a=rr*4+common;    //rr*5+common-rr
+            fits[l]&=(len[l]<=k)|(a==ans[l]);
+        }
+    }
+    
+    //Set fits for every lane still playing whose first longest answers code c fits
+    void test(int c,int longest){
+        fill(fits.begin(),fits.begin()+n,1);
+        for(int k=0;k<longest;k++){
+            fitKernel(n,k,table.digit[c],table.count[c],
+                      &digit[(k*4)*lanes],&digit[(k*4+1)*lanes],
+                      &digit[(k*4+2)*lanes],&digit[(k*4+3)*lanes],
+                      &count[(k*10)*lanes],lanes,&answer[k*lanes],&len[0],&fits[0]);
+        }
+    }
+    
+    //Move the game in lane from to lane to
+    void moveLane(int from,int to){
+        secret[to]=secret[from];
+        game[to]=game[from];
+        len[to]=len[from];
+        for(int k=0;k<maxGuess;k++){
+            for(int i=0;i<4;i++)digit[(k*4+i)*lanes+to]=digit[(k*4+i)*lanes+from];
+            for(int d=0;d<10;d++)count[(k*10+d)*lanes+to]=count[(k*10+d)*lanes+from];
+            answer[k*lanes+to]=answer[k*lanes+from];
+        }
+    }
+    
+    //Play every game to the end, guesses[g] is the number of guesses of game g
+    void solve(vector<int> &guesses){
+        guesses.assign(lanes,0);
+        int longest=0;
+        for(int i=0;i<10000&&n>0;i++){
+            int c=i*fitStep%10000;
+            test(c,longest);
+            //Games that take c as their next guess, usually only a few, so
+            //skip 8 lanes at a time while none of them fits
+            for(int l=n-1;l>=0;l--){
+                if(l>=7&&(l&7)==7){
+                    uint64_t eight;
+                    memcpy(&eight,&fits[l-7],8);
+                    if(!eight){
+                        l-=7;
+                        continue;
+                    }
+                }
+                if(!fits[l])continue;
+                int a=score(c,secret[l]);
+                if(a==20){
+                    guesses[game[l]]=len[l]+1;
+                    moveLane(--n,l);
+                    continue;
+                }
+                push(l,c,a);
+                longest=max(longest,static_cast<int>(len[l]));
+            }
+        }
+    }
+    
+    //Add guess c with answer a to the history of lane l, full histories stay as they are
+    void push(int l,int c,int a){
+        int k=len[l];
+        if(k==maxGuess)return;
+        for(int i=0;i<4;i++)digit[(k*4+i)*lanes+l]=table.digit[c][i];
+        for(int d=0;d<10;d++)count[(k*10+d)*lanes+l]=table.count[c][d];
+        answer[k*lanes+l]=a;
+        len[l]=k+1;
+    }
+    
+    //Next first fit guess of every lane from the histories given with push(),
+    //next[g] is -1 when no code fits the answers of game g
+    void firstFits(vector<short> &next){
+        next.assign(lanes,-1);
+        int longest=*max_element(len.begin(),len.end());
+        for(int i=0;i<10000&&n>0;i++){
+            int c=i*fitStep%10000;
+            test(c,longest);
+            for(int l=n-1;l>=0;l--){
+                if(!fits[l])continue;
+                next[game[l]]=c;
+                moveLane(--n,l);
+            }
+        }
+    }
+};
+
+//Solve a batch of games three ways and report games solved per second:
+//AI() with eval() one game at a time, first fit one game at a time, and
+//first fit with GameBatch. Game g hides code g%10000.
+void batchGames(int games){
+    vector<short> codes(games);
+    for(int g=0;g<games;g++)codes[g]=g%10000;
+    
+    //AI() and eval() one game at a time, AI() prints so its output is dropped
+    ostringstream quiet;
+    streambuf *old=cout.rdbuf(quiet.rdbuf());
+    long long aiGuess=0;
+    auto t0=chrono::steady_clock::now();
+    for(int g=0;g<games;g++){
+        string code="0000",guess;
+        for(int i=0;i<4;i++)code[i]=table.digit[codes[g]][i]+'0';
+        char rr=0,rw=0;
+        int n=0;
+        AI(0,0,true);
+        do{
+            n++;
+            guess=AI(rr,rw);
+        }while(eval(code,guess,rr,rw)&&n<50);
+        aiGuess+=n;
+        quiet.str("");
+    }
+    double aiSec=chrono::duration<double>(chrono::steady_clock::now()-t0).count();
+    cout.rdbuf(old);
+    
+    //First fit one game at a time
+    vector<int> single(games);
+    t0=chrono::steady_clock::now();
+    for(int g=0;g<games;g++)single[g]=firstFit(codes[g]);
+    double singleSec=chrono::duration<double>(chrono::steady_clock::now()-t0).count();
+    
+    //First fit with every game in its own lane
+    vector<int> batched;
+    t0=chrono::steady_clock::now();
+    GameBatch batch(codes);
+    batch.solve(batched);
+    double batchSec=chrono::duration<double>(chrono::steady_clock::now()-t0).count();
+    
+    long long fitGuess=accumulate(single.begin(),single.end(),0LL);
+    cout<<left<<setw(24)<<"solver"<<right<<setw(16)<<"games/sec"<<setw(14)<<"guesses/game"<<endl;
+    cout<<fixed<<setprecision(1);
+    cout<<left<<setw(24)<<"AI() one at a time"<<right<<setw(16)<<games/aiSec
+        <<setw(14)<<static_cast<double>(aiGuess)/games<<endl;
+    cout<<left<<setw(24)<<"first fit one at a time"<<right<<setw(16)<<games/singleSec
+        <<setw(14)<<static_cast<double>(fitGuess)/games<<endl;
+    cout<<left<<setw(24)<<"first fit batched"<<right<<setw(16)<<games/batchSec
+        <<setw(14)<<static_cast<double>(accumulate(batched.begin(),batched.end(),0LL))/games<<endl;
+    cout<<"Batched guess counts "<<(batched==single?"match":"DIFFER FROM")
+        <<" one at a time"<<endl;
+}
+
+//Value below which p percent of v lies, v is reordered
+double percentile(vector<double> &v,double p){
+    if(v.empty())return 0;
+    size_t k=min(v.size()-1,static_cast<size_t>(p/100*v.size()));
+    nth_element(v.begin(),v.begin()+k,v.end());
+    return v[k];
+}
+
+//Send all of text, false once the other side is gone
+bool sendAll(int fd,const string &text){
+    size_t sent=0;
+    while(sent<text.size()){
+        ssize_t n=send(fd,text.data()+sent,text.size()-sent,MSG_NOSIGNAL);
+        if(n<=0)return false;
+        sent+=n;
+    }
+    return true;
+}
+
+//Next line from fd without the newline, buffer keeps what came after it
+bool readLine(int fd,string &buffer,string &line){
+    size_t end;
+    while((end=buffer.find('\n'))==string::npos){
+        char chunk[4096];
+        ssize_t n=recv(fd,chunk,sizeof(chunk),0);
+        if(n<=0)return false;
+        buffer.append(chunk,n);
+    }
+    line=buffer.substr(0,end);
+    buffer.erase(0,end+1);
+    return true;
+}
+
+//One "feedback history -> next guess" request
+//The request line is [ai|fit] then guess:answer pairs, e.g. "fit 0123:01 4567:10"
+//for 0 right place 1 wrong place after 0123 and 1 right place after 4567, and
+//the reply line is the next guess. fit (the default) answers with the first fit
+//guess for the history, ai replays the answers through AI() and ignores the
+//guesses, which must be the ones AI() made.
+struct Request{
+    bool useAI;
+    vector<short> guess;
+    vector<unsigned char> answer;       //Right place*5 + wrong place
+    chrono::steady_clock::time_point arrived;
+    promise<string> reply;
+};
+
+//Fill r from a request line, false if the line is not a request
+bool parseRequest(const string &line,Request &r){
+    istringstream in(line);
+    string word;
+    r.useAI=false;
+    while(in>>word){
+        if(word=="ai"||word=="fit"){
+            r.useAI=word=="ai";
+            continue;
+        }
+        if(word.size()!=7||word[4]!=':')return false;
+        for(int i:{0,1,2,3,5,6})if(word[i]<'0'||word[i]>'9')return false;
+        int rr=word[5]-'0',rw=word[6]-'0';
+        if(rr+rw>4)return false;
+        r.guess.push_back(stoi(word.substr(0,4)));
+        r.answer.push_back(rr*5+rw);
+    }
+    return r.useAI||r.guess.size()<=GameBatch::maxGuess;
+}
+
+//SolveService answers requests from many connections in micro-batches
+//Connection threads queue their requests and wait for the reply. A batcher
+//thread closes a batch when it has maxBatch requests or its first request has
+//waited maxWait, and a pool of workers solves whole batches: all the first fit
+//requests of a batch go through one GameBatch sweep over the shared code table,
+//AI() requests each replay their answers with their own AIState. The latency
+//of every request, from arrival to reply sent, is kept for the p50/p99 report.
+//On shutdown every queued request is still answered before the threads exit.
+class SolveService{
+private:
+    static const int maxBatch=64;
+    const chrono::microseconds maxWait{200};
+    mutex lock;
+    condition_variable pendingReady,batchReady;
+    deque<Request*> pending;            //Requests not in a batch yet
+    deque<vector<Request*>> batches;    //Closed batches waiting for a worker
+    bool stopping=false;
+    bool flushed=false;                 //Batcher has closed its last batch
+    mutex statsLock;
+    vector<double> latencies;           //ms, since the last report
+    long long served=0;                 //Since the last report
+    vector<thread> threads;
+    
+    void batcher(){
+        unique_lock<mutex> hold(lock);
+        while(true){
+            pendingReady.wait(hold,[this]{return stopping||!pending.empty();});
+            if(stopping){
+                while(!pending.empty()){
+                    size_t take=min(pending.size(),static_cast<size_t>(maxBatch));
+                    batches.emplace_back(pending.begin(),pending.begin()+take);
+                    pending.erase(pending.begin(),pending.begin()+take);
+                }
+                flushed=true;
+                batchReady.notify_all();
+                return;
+            }
+            auto close=pending.front()->arrived+maxWait;
+            pendingReady.wait_until(hold,close,[this]{
+                return stopping||pending.size()>=static_cast<size_t>(maxBatch);});
+            size_t take=min(pending.size(),static_cast<size_t>(maxBatch));
+            batches.emplace_back(pending.begin(),pending.begin()+take);
+            pending.erase(pending.begin(),pending.begin()+take);
+            batchReady.notify_one();
+        }
+    }
+    
+    void worker(){
+        while(true){
+            vector<Request*> batch;
+            {
+                unique_lock<mutex> hold(lock);
+                batchReady.wait(hold,[this]{return flushed||!batches.empty();});
+                if(batches.empty())return;
+                batch=move(batches.front());
+                batches.pop_front();
+            }
+            solve(batch);
+        }
+    }
+    
+    static string codeText(int c){
+        if(c<0)return "error no code fits";
+        string text="0000";
+        for(int i=0;i<4;i++)text[i]=table.digit[c][i]+'0';
+        return text;
+    }
+    
+    void solve(vector<Request*> &batch){
+        vector<Request*> fit;
+        for(Request *r:batch){
+            if(!r->useAI){
+                fit.push_back(r);
+                continue;
+            }
+            AIState state;
+            state.log=nullptr;
+            string guess=AI(0,0,state);
+            for(unsigned char a:r->answer)guess=AI(a/5,a%5,state);
+            r->reply.set_value(guess);
+        }
+        if(fit.empty())return;
+        GameBatch lanes(vector<short>(fit.size(),0));
+        for(size_t g=0;g<fit.size();g++){
+            for(size_t k=0;k<fit[g]->guess.size();k++){
+                lanes.push(g,fit[g]->guess[k],fit[g]->answer[k]);
+            }
+        }
+        vector<short> next;
+        lanes.firstFits(next);
+        for(size_t g=0;g<fit.size();g++)fit[g]->reply.set_value(codeText(next[g]));
+    }
+    
+public:
+    SolveService(int nThread){
+        threads.emplace_back(&SolveService::batcher,this);
+        for(int t=0;t<nThread;t++)threads.emplace_back(&SolveService::worker,this);
+    }
+    
+    ~SolveService(){
+        {
+            lock_guard<mutex> hold(lock);
+            stopping=true;
+        }
+        pendingReady.notify_all();
+        batchReady.notify_all();
+        for(auto &t:threads)t.join();
+    }
+    
+    //Queue r and wait for its reply
+    string ask(Request &r){
+        future<string> reply=r.reply.get_future();
+        {
+            lock_guard<mutex> hold(lock);
+            pending.push_back(&r);
+        }
+        pendingReady.notify_one();
+        return reply.get();
+    }
+    
+    void record(double ms){
+        lock_guard<mutex> hold(statsLock);
+        latencies.push_back(ms);
+        served++;
+    }
+    
+    //Print requests/sec and latency percentiles since the last report
+    void report(double seconds){
+        vector<double> ms;
+        long long n;
+        {
+            lock_guard<mutex> hold(statsLock);
+            ms.swap(latencies);
+            n=served;
+            served=0;
+        }
+        if(n==0)return;
+        cout<<fixed<<setprecision(3)<<n/seconds<<" requests/sec, p50 "
+            <<percentile(ms,50)<<" ms, p99 "<<percentile(ms,99)<<" ms"<<endl;
+    }
+};
+
+//Answer one connection's requests line by line until it closes
+//serve() closes fd once the thread has finished and sets done
+void connection(int fd,SolveService *service,atomic<bool> *done){
+    string buffer,line;
+    while(readLine(fd,buffer,line)){
+        Request r;
+        r.arrived=chrono::steady_clock::now();
+        string reply=parseRequest(line,r)?service->ask(r):"error bad request";
+        if(!sendAll(fd,reply+"\n"))break;
+        service->record(chrono::duration<double,milli>(chrono::steady_clock::now()-r.arrived).count());
+    }
+    *done=true;
+}
+
+//Listen on a Unix domain socket at path and report every 5 seconds
+//Runs for the given seconds, or until killed when seconds is 0. At the end
+//open connections are shut down and their threads joined before the service
+//goes away, so no thread is left waiting on it.
+void serve(const char *path,int nThread,double seconds){
+    int fd=socket(AF_UNIX,SOCK_STREAM,0);
+    sockaddr_un addr;
+    memset(&addr,0,sizeof(addr));
+    addr.sun_family=AF_UNIX;
+    strncpy(addr.sun_path,path,sizeof(addr.sun_path)-1);
+    unlink(path);
+    if(fd<0||bind(fd,reinterpret_cast<sockaddr*>(&addr),sizeof(addr))!=0||listen(fd,64)!=0){
+        cout<<"Could not listen on "<<path<<endl;
+        return;
+    }
+    cout<<"Serving on "<<path<<" with "<<nThread<<" workers"<<endl;
+    SolveService service(nThread);
+    atomic<bool> done(false);
+    thread reporter([&]{
+        auto start=chrono::steady_clock::now(),last=start;
+        while(!done){
+            this_thread::sleep_for(chrono::milliseconds(100));
+            auto now=chrono::steady_clock::now();
+            if(now-last>=chrono::seconds(5)){
+                service.report(chrono::duration<double>(now-last).count());
+                last=now;
+            }
+            if(seconds>0&&now-start>=chrono::duration<double>(seconds)){
+                service.report(chrono::duration<double>(now-last).count());
+                done=true;
+                shutdown(fd,SHUT_RDWR);     //Wakes up accept()
+            }
+        }
+    });
+    struct Connection{
+        int fd;
+        unique_ptr<atomic<bool>> finished;
+        thread worker;
+    };
+    list<Connection> conns;
+    auto reap=[&conns](bool all){
+        for(auto c=conns.begin();c!=conns.end();){
+            if(!all&&!*c->finished){
+                c++;
+                continue;
+            }
+            if(all)shutdown(c->fd,SHUT_RDWR);  //Wakes up a blocked read
+            c->worker.join();
+            close(c->fd);
+            c=conns.erase(c);
+        }
+    };
+    while(!done){
+        int conn=accept(fd,nullptr,nullptr);
+        if(conn<0)break;
+        reap(false);
+        conns.push_back({conn,make_unique<atomic<bool>>(false),thread()});
+        conns.back().worker=thread(connection,conn,&service,conns.back().finished.get());
+    }
+    done=true;
+    reap(true);
+    reporter.join();
+    close(fd);
+    unlink(path);
+}
+
+//Play games through the service on several connections at once and report
+//the latency of every request as the client sees it
+void client(const char *path,int games,int connections,bool useAI){
+    mutex statsLock;
+    vector<double> latencies;
+    long long totGuess=0,failed=0;
+    auto start=chrono::steady_clock::now();
+    vector<thread> pool;
+    for(int t=0;t<connections;t++){
+        pool.emplace_back([&,t]{
+            int fd=socket(AF_UNIX,SOCK_STREAM,0);
+            sockaddr_un addr;
+            memset(&addr,0,sizeof(addr));
+            addr.sun_family=AF_UNIX;
+            strncpy(addr.sun_path,path,sizeof(addr.sun_path)-1);
+            if(fd<0||connect(fd,reinterpret_cast<sockaddr*>(&addr),sizeof(addr))!=0){
+                lock_guard<mutex> hold(statsLock);
+                failed++;
+                return;
+            }
+            vector<double> ms;
+            long long guesses=0;
+            string buffer,line;
+            for(int g=t;g<games;g+=connections){
+                int secret=(g*7919)%10000;
+                string history=useAI?"ai":"fit";
+                for(int n=1;n<=50;n++){
+                    auto t0=chrono::steady_clock::now();
+                    if(!sendAll(fd,history+"\n")||!readLine(fd,buffer,line))break;
+                    ms.push_back(chrono::duration<double,milli>(chrono::steady_clock::now()-t0).count());
+                    bool isCode=line.size()==4&&all_of(line.begin(),line.end(),
+                                                       [](char d){return d>='0'&&d<='9';});
+                    int a;
+                    if(isCode){
+                        a=score(stoi(line),secret);
+                    }else{
+                        //AI() guesses '/' for untested places
+                        string code="0000";
+                        char rr,rw;
+                        for(int i=0;i<4;i++)code[i]=table.digit[secret][i]+'0';
+                        eval(code,line,rr,rw);
+                        a=rr*5+rw;
+                    }
+                    if(a==20||line.compare(0,5,"error")==0){
+                        guesses+=n;
+                        break;
+                    }
+                    history+=' ';
+                    history.append(isCode?line:"0000");
+                    history+=':';
+                    history+=char('0'+a/5);
+                    history+=char('0'+a%5);
+                }
+            }
+            close(fd);
+            lock_guard<mutex> hold(statsLock);
+            latencies.insert(latencies.end(),ms.begin(),ms.end());
+            totGuess+=guesses;
+        });
+    }
+    for(auto &t:pool)t.join();
+    double seconds=chrono::duration<double>(chrono::steady_clock::now()-start).count();
+    if(failed){
+        cout<<"Could not connect to "<<path<<endl;
+        return;
+    }
+    cout<<fixed<<setprecision(3);
+    cout<<games<<" games, "<<latencies.size()<<" requests on "<<connections<<" connections"<<endl;
+    cout<<latencies.size()/seconds<<" requests/sec, p50 "<<percentile(latencies,50)
+        <<" ms, p99 "<<percentile(latencies,99)<<" ms"<<endl;
+    cout<<"Average guesses per game = "<<static_cast<double>(totGuess)/games<<endl;
+}
+
+//Time eval() and full AI() games, report ns/op and allocations/op
+//Writes name,iterations,ns_per_op,allocs_per_op,ops_per_sec lines to the file
+void bench(const char *csvFile){
+    const int nEval=1000000, nGames=20000;
+    string names[2]={"eval","AI_game"};
+    long long iters[2]={nEval,nGames};
+    double ns[2],allocs[2];
+    
+    //Build the codes and guesses up front so set() is not in the timing
+    string codes[64],guesses[64];
+    for(int i=0;i<64;i++){
+        codes[i]=set();
+        guesses[i]=set();
+    }
+    
+    //eval() on its own
+    char rr,rw;
+    long long sink=0;
+    size_t a0=allocCount;
+    auto t0=chrono::steady_clock::now();
+    for(int i=0;i<nEval;i++){
+        sink+=eval(codes[i&63],guesses[(i*7)&63],rr,rw);
+        sink+=rr+rw;
+    }
+    auto t1=chrono::steady_clock::now();
+    ns[0]=chrono::duration<double,nano>(t1-t0).count()/nEval;
+    allocs[0]=static_cast<double>(allocCount-a0)/nEval;
+    
+    //Whole games, AI() prints while it works so send cout to a sink
+    ostringstream quiet;
+    streambuf *old=cout.rdbuf(quiet.rdbuf());
+    long long totGuess=0;
+    a0=allocCount;
+    t0=chrono::steady_clock::now();
+    for(int g=0;g<nGames;g++){
+        string code=codes[g&63],guess;
+        AI(0,0,true);
+        rr=rw=0;
+        int n=0;
+        do{
+            n++;
+            guess=AI(rr,rw);
+        }while(eval(code,guess,rr,rw)&&n<50);
+        totGuess+=n;
+        quiet.str("");
+    }
+    t1=chrono::steady_clock::now();
+    cout.rdbuf(old);
+    ns[1]=chrono::duration<double,nano>(t1-t0).count()/nGames;
+    allocs[1]=static_cast<double>(allocCount-a0)/nGames;
+    
+    //Human readable table then the CSV
+    cout<<left<<setw(10)<<"benchmark"<<right<<setw(14)<<"ns/op"
+        <<setw(14)<<"allocs/op"<<setw(16)<<"ops/sec"<<endl;
+    for(int i=0;i<2;i++){
+        cout<<left<<setw(10)<<names[i]<<right<<fixed<<setprecision(1)
+            <<setw(14)<<ns[i]<<setw(14)<<allocs[i]<<setw(16)<<1e9/ns[i]<<endl;
+    }
+    cout<<"Average guesses per game = "<<static_cast<double>(totGuess)/nGames<<endl;
+    if(sink==42)cout<<endl;     //Keeps the eval loop from being optimized away
+    if(csvFile){
+        ofstream out(csvFile);
+        out<<"name,iterations,ns_per_op,allocs_per_op,ops_per_sec"<<endl;
+        for(int i=0;i<2;i++){
+            out<<"mastermind/"<<names[i]<<','<<iters[i]<<','<<ns[i]<<','
+               <<allocs[i]<<','<<1e9/ns[i]<<endl;
+        }
+    }
+}